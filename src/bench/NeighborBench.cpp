@@ -0,0 +1,325 @@
+// Standalone neighbor-search benchmark (no window, no GL).
+// Generates reproducible particle distributions, times SpatialGrid builds
+// and queries over particle counts, layouts and cell sizes, and prints one
+// CSV row per configuration so runs can be diffed or plotted. Before timing,
+// each configuration checks that the hashed and dense layouts find the same
+// neighbors (exit status 1 if not).
+//
+//   make bench
+//   ./build/NeighborBench [--counts 10000,50000,200000] [--reps 5]
+//                         [--threads 1] [--queries 2048] [--seed 1234]
+
+#include "../engine/Kernels.h"
+#include "../engine/SpatialGrid.h"
+#include "../engine/ThreadPool.h"
+#include "../particle/ParticleStore.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Same room as main.cpp, the scene's standard smoothing radius
+const float ROOM_MIN[3] = {-25.0f, -15.0f, -25.0f};
+const float ROOM_MAX[3] = {25.0f, 15.0f, 25.0f};
+const float RADIUS = Kernel::Standard::params().h;
+const int KNN_K = 16;
+
+enum Distribution { UNIFORM, PLUME, STACK, DISTRIBUTION_COUNT };
+const char *DISTRIBUTION_NAMES[] = {"uniform", "plume", "stack"};
+
+struct Options {
+  std::vector<int> counts;
+  int reps = 5;
+  int threads = 1;
+  int queries = 2048;
+  unsigned seed = 1234;
+};
+
+// A. Distributions
+void Generate(Distribution dist, int count, unsigned seed,
+              ParticleStore &particles) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  particles.clear();
+  particles.resize(count);
+
+  for (int i = 0; i < count; ++i) {
+    particles.active[i] = 1;
+    particles.ids[i] = i;
+    float *position = particles.position(i);
+
+    switch (dist) {
+    case UNIFORM:
+      // Steam that has spread through the whole room
+      for (int a = 0; a < 3; ++a)
+        position[a] = ROOM_MIN[a] + unit(rng) * (ROOM_MAX[a] - ROOM_MIN[a]);
+      break;
+    case PLUME: {
+      // Column rising from the Kurna: dense at the spout, widening and
+      // thinning with height
+      std::exponential_distribution<float> rise(1.0f / 6.0f);
+      float y = std::min(-14.0f + rise(rng), ROOM_MAX[1]);
+      std::normal_distribution<float> spread(0.0f,
+                                             0.75f + 0.15f * (y + 14.0f));
+      position[0] = spread(rng);
+      position[1] = y;
+      position[2] = spread(rng);
+      break;
+    }
+    case STACK:
+      // Degenerate: everything piled into one cell at the spout
+      for (int a = 0; a < 3; ++a)
+        position[a] = (unit(rng) - 0.5f) * 0.01f;
+      position[1] -= 14.0f;
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+// B. Timing
+typedef std::chrono::steady_clock Clock;
+
+double ElapsedMs(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+double Median(std::vector<double> samples) {
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+struct Result {
+  double buildMs = 0.0;
+  double stencilMs = 0.0; // 27/125-cell candidate walk + radius test
+  double rangeMs = 0.0;   // ForEachInRadius
+  double knnMs = 0.0;     // FindKNearest
+  int queries = 0;        // Every stride-th particle is a query point
+  double candidates = 0.0; // Per stencil query
+  double neighbors = 0.0;  // Per query, doubles as a checksum
+  double inRange = 0.0;    // ForEachInRadius hits per query, same
+  double kthDist2 = 0.0;   // Mean squared distance of the k-th nearest
+};
+
+Result Run(const ParticleStore &particles, SpatialGrid &grid,
+           ThreadPool *pool, const Options &opt) {
+  Result res;
+  const float radius2 = RADIUS * RADIUS;
+  int stride = std::max(1, (int)particles.size() / opt.queries);
+  int queries = ((int)particles.size() + stride - 1) / stride;
+  res.queries = queries;
+
+  grid.Build(particles, pool); // Warm up allocations
+
+  std::vector<double> build, stencil, range, knn;
+  for (int rep = 0; rep < opt.reps; ++rep) {
+    Clock::time_point t = Clock::now();
+    grid.Build(particles, pool);
+    build.push_back(ElapsedMs(t));
+
+    long candidates = 0, neighbors = 0;
+    t = Clock::now();
+    for (size_t q = 0; q < particles.size(); q += stride) {
+      const float *c = particles.position(q);
+      grid.ForEachNeighbor(c, [&](int j) {
+        const float *pj = particles.position(j);
+        float dx = pj[0] - c[0], dy = pj[1] - c[1], dz = pj[2] - c[2];
+        candidates++;
+        if (dx * dx + dy * dy + dz * dz < radius2)
+          neighbors++;
+      });
+    }
+    stencil.push_back(ElapsedMs(t));
+    res.candidates = (double)candidates / queries;
+    res.neighbors = (double)neighbors / queries;
+
+    long inRange = 0;
+    t = Clock::now();
+    for (size_t q = 0; q < particles.size(); q += stride)
+      grid.ForEachInRadius(particles.position(q), RADIUS, particles,
+                           [&inRange](int, float) { inRange++; });
+    range.push_back(ElapsedMs(t));
+    res.inRange = (double)inRange / queries;
+
+    int indices[KNN_K];
+    float dist2[KNN_K];
+    double kthSum = 0.0;
+    t = Clock::now();
+    for (size_t q = 0; q < particles.size(); q += stride) {
+      int n = grid.FindKNearest(particles.position(q), KNN_K, particles,
+                                indices, dist2);
+      kthSum += n > 0 ? dist2[n - 1] : 0.0;
+    }
+    knn.push_back(ElapsedMs(t));
+    res.kthDist2 = kthSum / queries;
+  }
+
+  res.buildMs = Median(build);
+  res.stencilMs = Median(stencil);
+  res.rangeMs = Median(range);
+  res.knnMs = Median(knn);
+  return res;
+}
+
+// C. Layout check
+// The stencil walk must hand out each in-range particle exactly once in
+// both layouts. Collects every query's in-range candidates (duplicates
+// kept) from a hashed and a dense grid and returns the queries whose lists
+// differ.
+int CheckLayouts(const ParticleStore &particles, int cellsPerRadius,
+                 ThreadPool *pool, int queries) {
+  const float radius2 = RADIUS * RADIUS;
+  vec3 roomMin = {ROOM_MIN[0], ROOM_MIN[1], ROOM_MIN[2]};
+  vec3 roomMax = {ROOM_MAX[0], ROOM_MAX[1], ROOM_MAX[2]};
+  SpatialGrid hashed, dense;
+  hashed.SetSearchRadius(RADIUS, cellsPerRadius);
+  dense.SetSearchRadius(RADIUS, cellsPerRadius);
+  dense.SetBounds(roomMin, roomMax);
+  hashed.Build(particles, pool);
+  dense.Build(particles, pool);
+
+  auto collect = [&](const SpatialGrid &grid, const float *c,
+                     std::vector<int> &out) {
+    out.clear();
+    grid.ForEachNeighbor(c, [&](int j) {
+      const float *pj = particles.position(j);
+      float dx = pj[0] - c[0], dy = pj[1] - c[1], dz = pj[2] - c[2];
+      if (dx * dx + dy * dy + dz * dz < radius2)
+        out.push_back(j);
+    });
+    std::sort(out.begin(), out.end());
+  };
+
+  int stride = std::max(1, (int)particles.size() / queries);
+  int mismatches = 0;
+  std::vector<int> a, b;
+  for (size_t q = 0; q < particles.size(); q += stride) {
+    collect(hashed, particles.position(q), a);
+    collect(dense, particles.position(q), b);
+    if (a != b)
+      mismatches++;
+  }
+  return mismatches;
+}
+
+// D. Command line
+std::vector<int> ParseCounts(const char *arg) {
+  std::vector<int> counts;
+  for (const char *s = arg; *s;) {
+    char *end;
+    long v = std::strtol(s, &end, 10);
+    if (end == s)
+      break;
+    if (v > 0)
+      counts.push_back((int)v);
+    s = *end == ',' ? end + 1 : end;
+  }
+  return counts;
+}
+
+bool ParseArgs(int argc, char **argv, Options &opt) {
+  for (int i = 1; i < argc; ++i) {
+    bool hasValue = i + 1 < argc;
+    if (!std::strcmp(argv[i], "--counts") && hasValue)
+      opt.counts = ParseCounts(argv[++i]);
+    else if (!std::strcmp(argv[i], "--reps") && hasValue)
+      opt.reps = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--threads") && hasValue)
+      opt.threads = std::max(0, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--queries") && hasValue)
+      opt.queries = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--seed") && hasValue)
+      opt.seed = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+    else
+      return false;
+  }
+  if (opt.counts.empty()) {
+    opt.counts.push_back(10000);
+    opt.counts.push_back(50000);
+    opt.counts.push_back(200000);
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options opt;
+  if (!ParseArgs(argc, argv, opt)) {
+    std::fprintf(stderr,
+                 "usage: %s [--counts N,N,...] [--reps N] [--threads N] "
+                 "[--queries N] [--seed N]\n",
+                 argv[0]);
+    return 1;
+  }
+
+  ThreadPool pool(opt.threads);
+  ThreadPool *buildPool = pool.getThreadCount() > 1 ? &pool : nullptr;
+
+  vec3 roomMin = {ROOM_MIN[0], ROOM_MIN[1], ROOM_MIN[2]};
+  vec3 roomMax = {ROOM_MAX[0], ROOM_MAX[1], ROOM_MAX[2]};
+  const int cellsPerRadius[] = {1, 2, 3};
+
+  std::printf("distribution,layout,particles,cell_size,stencil_cells,"
+              "threads,build_ms,stencil_ms,range_ms,knn_ms,queries,"
+              "candidates_per_query,neighbors_per_query,range_per_query,"
+              "kth_dist2\n");
+
+  ParticleStore particles;
+  bool failed = false; // Layout check
+  for (int d = 0; d < DISTRIBUTION_COUNT; ++d) {
+    for (size_t c = 0; c < opt.counts.size(); ++c) {
+      int count = opt.counts[c];
+      Generate((Distribution)d, count, opt.seed + d, particles);
+
+      // Every stacked query walks the whole pile; cap the pairs touched so
+      // the degenerate case stays measurable at large counts
+      Options runOpt = opt;
+      if (d == STACK)
+        runOpt.queries =
+            std::max(1, std::min(opt.queries, (int)(20000000LL / count)));
+
+      for (int cpr : cellsPerRadius) {
+        int mismatches = CheckLayouts(particles, cpr, buildPool,
+                                      runOpt.queries);
+        if (mismatches > 0) {
+          std::fprintf(stderr,
+                       "# %s, %d particles, %d cells per radius: hashed and "
+                       "dense neighbors differ for %d queries\n",
+                       DISTRIBUTION_NAMES[d], count, cpr, mismatches);
+          failed = true;
+        }
+      }
+
+      for (int dense = 0; dense < 2; ++dense) {
+        for (int cpr : cellsPerRadius) {
+          SpatialGrid grid;
+          grid.SetSearchRadius(RADIUS, cpr);
+          if (dense)
+            grid.SetBounds(roomMin, roomMax);
+
+          Result r = Run(particles, grid, buildPool, runOpt);
+          int side = 2 * cpr + 1;
+          std::printf(
+              "%s,%s,%d,%.4f,%d,%d,%.3f,%.3f,%.3f,%.3f,%d,%.2f,%.2f,%.2f,"
+              "%.4f\n",
+              DISTRIBUTION_NAMES[d], grid.isDense() ? "dense" : "hashed",
+              count, grid.getCellSize(), side * side * side,
+              pool.getThreadCount(), r.buildMs, r.stencilMs, r.rangeMs,
+              r.knnMs, r.queries, r.candidates, r.neighbors, r.inRange,
+              r.kthDist2);
+          std::fflush(stdout);
+        }
+      }
+    }
+  }
+  return failed ? 1 : 0;
+}
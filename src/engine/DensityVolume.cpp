@@ -32,33 +32,93 @@ DensityVolume::~DensityVolume() {}
 
 void DensityVolume::Clear() { std::fill(data.begin(), data.end(), 0.0f); }
 
-void DensityVolume::Build(const std::vector<SteamParticle> &particles) {
-  Clear();
+void DensityVolume::Build(const ParticleStore &particles, size_t count,
+                          ThreadPool *pool) {
+  const int slabVoxels = width * height;
+  const int buckets = depth + 2;
+  weightSums.resize(slabVoxels * depth);
+
+  auto forEach = [pool](int count, const std::function<void(int, int, int)> &fn) {
+    if (pool)
+      pool->ParallelForDynamic(count, 1, fn);
+    else
+      fn(0, count, 0);
+  };
+
+  // Clear, a slab per task
+  forEach(depth, [&](int begin, int end, int) {
+    std::fill(data.begin() + begin * slabVoxels * 2,
+              data.begin() + end * slabVoxels * 2, 0.0f);
+    std::fill(weightSums.begin() + begin * slabVoxels,
+              weightSums.begin() + end * slabVoxels, 0.0f);
+  });
+
+  // Bucket the particles by centre slab (counting sort, index order kept)
+  slabStart.assign(buckets + 1, 0);
+  slabParticles.resize(count);
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t n = 0; n < count; n++) {
+      if (!particles.isActive(n))
+        continue;
+      float fz = (particles.position(n)[2] - minBounds[2]) / cellDepth;
+      int bucket = (int)(fz + 0.5f) + 1;
+      if (bucket < 0 || bucket >= buckets)
+        continue; // Splat misses the volume
+      if (pass == 0)
+        slabStart[bucket + 1]++;
+      else
+        slabParticles[slabStart[bucket]++] = (int)n;
+    }
+    if (pass == 0)
+      for (int b = 0; b < buckets; b++)
+        slabStart[b + 1] += slabStart[b];
+    else
+      for (int b = buckets; b > 0; b--)
+        slabStart[b] = slabStart[b - 1]; // Undo the fill's advance
+    slabStart[0] = 0;
+  }
+
+  // A bucket writes its own slab and the two below it, so buckets three
+  // apart never touch the same voxel: three passes of independent tasks.
+  // Every voxel sums its buckets in the same order on any thread count.
+  for (int phase = 0; phase < 3; phase++) {
+    int count = (buckets - phase + 2) / 3;
+    forEach(count, [&](int begin, int end, int) {
+      for (int t = begin; t < end; t++)
+        SplatSlab(particles, phase + t * 3);
+    });
+  }
 
-  // We need to track weight sums for proper temperature averaging
-  std::vector<float> weightSums(width * height * depth, 0.0f);
+  // Normalize temperature by weight sum to get proper average
+  forEach(depth, [&](int begin, int end, int) {
+    for (int i = begin * slabVoxels; i < end * slabVoxels; i++) {
+      if (weightSums[i] > 0.001f) {
+        data[i * 2 + 1] /= weightSums[i];
+      }
+    }
+  });
+}
 
-  // simple point splatting
-  // optimization: parallelize or use more complex kernel later
-  for (const auto &p : particles) {
-    if (!p.isActive())
-      continue;
+void DensityVolume::SplatSlab(const ParticleStore &particles, int bucket) {
+  for (int s = slabStart[bucket]; s < slabStart[bucket + 1]; s++) {
+    int n = slabParticles[s];
+    const float *position = particles.position(n);
 
     // Get particle temperature and normalize it
     // Assume temperature range is roughly 0-100 degrees
-    float particleTemp = p.getTemperature();
+    float particleTemp = particles.temperatures[n];
     float normalizedTemp = std::max(0.0f, std::min(particleTemp / 100.0f, 1.0f));
 
     // 1. Normalized Grid Coordinates (Float)
-    float fx = (p.position[0] - minBounds[0]) / cellWidth;
-    float fy = (p.position[1] - minBounds[1]) / cellHeight;
-    float fz = (p.position[2] - minBounds[2]) / cellDepth;
+    float fx = (position[0] - minBounds[0]) / cellWidth;
+    float fy = (position[1] - minBounds[1]) / cellHeight;
+    float fz = (position[2] - minBounds[2]) / cellDepth;
 
     // [NEW] Gaussian Splatting (3x3x3)
     // Center voxel indices (nearest integer)
     int cx = (int)(fx + 0.5f);
     int cy = (int)(fy + 0.5f);
-    int cz = (int)(fz + 0.5f);
+    int cz = bucket - 1;
 
     // Loop over 3x3x3 block
     for (int k = -1; k <= 1; k++) {
@@ -97,13 +157,6 @@ void DensityVolume::Build(const std::vector<SteamParticle> &particles) {
       }
     }
   }
-
-  // Normalize temperature by weight sum to get proper average
-  for (int i = 0; i < width * height * depth; i++) {
-    if (weightSums[i] > 0.001f) {
-      data[i * 2 + 1] /= weightSums[i];
-    }
-  }
 }
 
 void DensityVolume::getParams(int *w, int *h, int *d) const {
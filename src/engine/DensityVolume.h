@@ -4,17 +4,19 @@
 #include "SteamEngine.h" // For SteamParticle definiton if not separate.
 #include <cglm/cglm.h>
 #include <vector>
-// Actually SteamEngine.h includes SteamParticle.h usually, or we assume
-// SteamParticle is available.
-#include "../particle/SteamParticle.h"
+#include "../particle/ParticleStore.h"
+#include "ThreadPool.h"
 
 class DensityVolume {
 public:
   DensityVolume(int width = 64, int height = 64, int depth = 64);
   ~DensityVolume();
 
-  // Splat particles into the density grid
-  void Build(const std::vector<SteamParticle> &particles);
+  // Splat the particles in slots [0, count) into the density grid. With a
+  // pool, z slabs are splatted as parallel tasks; the result does not
+  // depend on the pool or its thread count.
+  void Build(const ParticleStore &particles, size_t count,
+             ThreadPool *pool = nullptr);
 
   // Get dimensions
   void getParams(int *w, int *h, int *d) const;
@@ -28,6 +30,14 @@ private:
   int width, height, depth;
   float cellWidth, cellHeight, cellDepth;
   std::vector<float> data; // 2 floats per voxel: [density, temperature]
+  std::vector<float> weightSums; // Per voxel, for temperature averaging
+
+  // Particles bucketed by the z slab their splat is centred on (slab + 1,
+  // so the slab below the volume that still reaches slab 0 is bucket 0)
+  std::vector<int> slabStart;
+  std::vector<int> slabParticles;
+
+  void SplatSlab(const ParticleStore &particles, int bucket);
 
   // Bounds of the volume (could be static or dynamic, for now static room
   // size?) Room is 30x30x30 often centered or on floor. Let's assume a fixed
@@ -1,40 +1,293 @@
 #include "Kernels.h"
 #include <cmath>
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846f
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNEL_X86 1
 #endif
 
 namespace Kernel {
-float h = 1.0f;
-float h2 = h * h;
-float h9 = pow(h, 9);
-float h6 = pow(h, 6);
-
-// Poly6 Kernel (For Density)
-float Poly6(float rSquared) {
-  if (rSquared < 0 || rSquared > h2)
-    return 0.0f;
-  float diff = h2 - rSquared;
-  return (315.0f / (64.0f * M_PI * h9)) * (diff * diff * diff);
-}
-
-// Spiky Kernel Gradient (For Pressure Force)
-void SpikyGrad(vec3 rVector, float rLen, vec3 dest) {
-  if (rLen <= 0 || rLen > h) {
-    glm_vec3_zero(dest);
+namespace {
+Params current = Standard::params();
+
+// A. Scalar, any family
+template <Family F>
+void DensityScalar(const Params &p, const float *r2, float *w, int begin,
+                   int count) {
+  for (int k = begin; k < count; k++)
+    w[k] = DensityOf<F>(p, r2[k]);
+}
+
+template <Family F>
+void GradientScalar(const Params &p, const float *dx, const float *dy,
+                    const float *dz, const float *r, float *gx, float *gy,
+                    float *gz, int begin, int count) {
+  for (int k = begin; k < count; k++) {
+    float scalar = GradScaleOf<F>(p, r[k]);
+    gx[k] = dx[k] * scalar;
+    gy[k] = dy[k] * scalar;
+    gz[k] = dz[k] * scalar;
+  }
+}
+
+void DensityScalar(const Params &p, const float *r2, float *w, int begin,
+                   int count) {
+  switch (p.family) {
+  case Family::CubicSpline:
+    DensityScalar<Family::CubicSpline>(p, r2, w, begin, count);
+    return;
+  case Family::WendlandC2:
+    DensityScalar<Family::WendlandC2>(p, r2, w, begin, count);
+    return;
+  default:
+    DensityScalar<Family::Poly6Spiky>(p, r2, w, begin, count);
+  }
+}
+
+void GradientScalar(const Params &p, const float *dx, const float *dy,
+                    const float *dz, const float *r, float *gx, float *gy,
+                    float *gz, int begin, int count) {
+  switch (p.family) {
+  case Family::CubicSpline:
+    GradientScalar<Family::CubicSpline>(p, dx, dy, dz, r, gx, gy, gz, begin,
+                                        count);
+    return;
+  case Family::WendlandC2:
+    GradientScalar<Family::WendlandC2>(p, dx, dy, dz, r, gx, gy, gz, begin,
+                                       count);
     return;
+  default:
+    GradientScalar<Family::Poly6Spiky>(p, dx, dy, dz, r, gx, gy, gz, begin,
+                                       count);
   }
-  float diff = h - rLen;
-  float coeff = -45.0f / (M_PI * h6);
+}
+
+#ifdef KERNEL_X86
+// B. SSE (4 lanes)
+__attribute__((target("sse2"))) void
+Poly6SSE(const Params &p, const float *r2, float *w, int count) {
+  const __m128 vh2 = _mm_set1_ps(p.h2), vc = _mm_set1_ps(p.densityCoeff),
+               zero = _mm_setzero_ps();
+  int k = 0;
+  for (; k + 4 <= count; k += 4) {
+    __m128 x = _mm_loadu_ps(r2 + k);
+    __m128 diff = _mm_sub_ps(vh2, x);
+    __m128 v = _mm_mul_ps(vc, _mm_mul_ps(_mm_mul_ps(diff, diff), diff));
+    __m128 in = _mm_and_ps(_mm_cmpge_ps(x, zero), _mm_cmple_ps(x, vh2));
+    _mm_storeu_ps(w + k, _mm_and_ps(in, v));
+  }
+  DensityScalar<Family::Poly6Spiky>(p, r2, w, k, count);
+}
 
-  // Direction = Normalize(rVector)
-  vec3 normalized;
-  glm_vec3_copy(rVector, normalized);
-  glm_vec3_normalize(normalized);
+__attribute__((target("sse2"))) void
+SpikyGradSSE(const Params &p, const float *dx, const float *dy,
+             const float *dz, const float *r, float *gx, float *gy, float *gz,
+             int count) {
+  const __m128 vh = _mm_set1_ps(p.h), vc = _mm_set1_ps(p.gradCoeff),
+               zero = _mm_setzero_ps();
+  int k = 0;
+  for (; k + 4 <= count; k += 4) {
+    __m128 x = _mm_loadu_ps(r + k);
+    __m128 diff = _mm_sub_ps(vh, x);
+    __m128 s = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(vc, diff), diff), x);
+    __m128 in = _mm_and_ps(_mm_cmpgt_ps(x, zero), _mm_cmple_ps(x, vh));
+    s = _mm_and_ps(in, s);
+    _mm_storeu_ps(gx + k, _mm_mul_ps(_mm_loadu_ps(dx + k), s));
+    _mm_storeu_ps(gy + k, _mm_mul_ps(_mm_loadu_ps(dy + k), s));
+    _mm_storeu_ps(gz + k, _mm_mul_ps(_mm_loadu_ps(dz + k), s));
+  }
+  GradientScalar<Family::Poly6Spiky>(p, dx, dy, dz, r, gx, gy, gz, k, count);
+}
+
+// C. AVX2 (8 lanes)
+__attribute__((target("avx2"))) void
+Poly6AVX2(const Params &p, const float *r2, float *w, int count) {
+  const __m256 vh2 = _mm256_set1_ps(p.h2),
+               vc = _mm256_set1_ps(p.densityCoeff), zero = _mm256_setzero_ps();
+  int k = 0;
+  for (; k + 8 <= count; k += 8) {
+    __m256 x = _mm256_loadu_ps(r2 + k);
+    __m256 diff = _mm256_sub_ps(vh2, x);
+    __m256 v =
+        _mm256_mul_ps(vc, _mm256_mul_ps(_mm256_mul_ps(diff, diff), diff));
+    __m256 in = _mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GE_OQ),
+                              _mm256_cmp_ps(x, vh2, _CMP_LE_OQ));
+    _mm256_storeu_ps(w + k, _mm256_and_ps(in, v));
+  }
+  DensityScalar<Family::Poly6Spiky>(p, r2, w, k, count);
+}
+
+__attribute__((target("avx2"))) void
+SpikyGradAVX2(const Params &p, const float *dx, const float *dy,
+              const float *dz, const float *r, float *gx, float *gy,
+              float *gz, int count) {
+  const __m256 vh = _mm256_set1_ps(p.h), vc = _mm256_set1_ps(p.gradCoeff),
+               zero = _mm256_setzero_ps();
+  int k = 0;
+  for (; k + 8 <= count; k += 8) {
+    __m256 x = _mm256_loadu_ps(r + k);
+    __m256 diff = _mm256_sub_ps(vh, x);
+    __m256 s =
+        _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(vc, diff), diff), x);
+    __m256 in = _mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GT_OQ),
+                              _mm256_cmp_ps(x, vh, _CMP_LE_OQ));
+    s = _mm256_and_ps(in, s);
+    _mm256_storeu_ps(gx + k, _mm256_mul_ps(_mm256_loadu_ps(dx + k), s));
+    _mm256_storeu_ps(gy + k, _mm256_mul_ps(_mm256_loadu_ps(dy + k), s));
+    _mm256_storeu_ps(gz + k, _mm256_mul_ps(_mm256_loadu_ps(dz + k), s));
+  }
+  GradientScalar<Family::Poly6Spiky>(p, dx, dy, dz, r, gx, gy, gz, k, count);
+}
+
+// D. AVX-512 (16 lanes, the tail as a masked batch)
+__attribute__((target("avx512f"))) void
+Poly6AVX512(const Params &p, const float *r2, float *w, int count) {
+  const __m512 vh2 = _mm512_set1_ps(p.h2),
+               vc = _mm512_set1_ps(p.densityCoeff), zero = _mm512_setzero_ps();
+  for (int k = 0; k < count; k += 16) {
+    __mmask16 lanes =
+        count - k >= 16 ? (__mmask16)0xFFFF
+                        : (__mmask16)((1u << (count - k)) - 1u);
+    __m512 x = _mm512_maskz_loadu_ps(lanes, r2 + k);
+    __m512 diff = _mm512_sub_ps(vh2, x);
+    __m512 v =
+        _mm512_mul_ps(vc, _mm512_mul_ps(_mm512_mul_ps(diff, diff), diff));
+    __mmask16 in = _mm512_cmp_ps_mask(x, zero, _CMP_GE_OQ) &
+                   _mm512_cmp_ps_mask(x, vh2, _CMP_LE_OQ);
+    _mm512_mask_storeu_ps(w + k, lanes,
+                          _mm512_maskz_mov_ps(in, v));
+  }
+}
+
+__attribute__((target("avx512f"))) void
+SpikyGradAVX512(const Params &p, const float *dx, const float *dy,
+                const float *dz, const float *r, float *gx, float *gy,
+                float *gz, int count) {
+  const __m512 vh = _mm512_set1_ps(p.h), vc = _mm512_set1_ps(p.gradCoeff),
+               zero = _mm512_setzero_ps();
+  for (int k = 0; k < count; k += 16) {
+    __mmask16 lanes =
+        count - k >= 16 ? (__mmask16)0xFFFF
+                        : (__mmask16)((1u << (count - k)) - 1u);
+    __m512 x = _mm512_maskz_loadu_ps(lanes, r + k);
+    __mmask16 in = lanes & _mm512_cmp_ps_mask(x, zero, _CMP_GT_OQ) &
+                   _mm512_cmp_ps_mask(x, vh, _CMP_LE_OQ);
+    __m512 diff = _mm512_sub_ps(vh, x);
+    __m512 s = _mm512_maskz_div_ps(
+        in, _mm512_mul_ps(_mm512_mul_ps(vc, diff), diff), x);
+    _mm512_mask_storeu_ps(
+        gx + k, lanes, _mm512_mul_ps(_mm512_maskz_loadu_ps(lanes, dx + k), s));
+    _mm512_mask_storeu_ps(
+        gy + k, lanes, _mm512_mul_ps(_mm512_maskz_loadu_ps(lanes, dy + k), s));
+    _mm512_mask_storeu_ps(
+        gz + k, lanes, _mm512_mul_ps(_mm512_maskz_loadu_ps(lanes, dz + k), s));
+  }
+}
+#endif
+
+// E. Dispatch
+SimdLevel DetectSimdLevel() {
+#ifdef KERNEL_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return SimdLevel::AVX512;
+  if (__builtin_cpu_supports("avx2"))
+    return SimdLevel::AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return SimdLevel::SSE;
+#endif
+  return SimdLevel::Scalar;
+}
+
+const SimdLevel supportedLevel = DetectSimdLevel();
+SimdLevel activeLevel = supportedLevel;
+} // namespace
+
+const Params &Current() { return current; }
+
+void SetRadius(float h) { current = MakeParams(current.family, h); }
+
+void SetFamily(Family family) { current = MakeParams(family, current.h); }
+
+const char *getFamilyName(Family family) {
+  static const char *names[] = {"Poly6 / Spiky", "Cubic spline",
+                                "Wendland C2"};
+  return names[(int)family];
+}
+
+float Density(float r2) {
+  float w;
+  DensityScalar(current, &r2, &w, 0, 1);
+  return w;
+}
+
+void Gradient(const vec3 rVector, float rLen, vec3 dest) {
+  GradientScalar(current, &rVector[0], &rVector[1], &rVector[2], &rLen,
+                 &dest[0], &dest[1], &dest[2], 0, 1);
+}
+
+void DensityBatch(const float *r2, float *w, int count) {
+  if (current.family == Family::Poly6Spiky &&
+      Poly6Batch(current, r2, w, count))
+    return;
+  DensityScalar(current, r2, w, 0, count);
+}
+
+void GradientBatch(const float *dx, const float *dy, const float *dz,
+                   const float *r, float *gx, float *gy, float *gz,
+                   int count) {
+  if (current.family == Family::Poly6Spiky &&
+      SpikyGradientBatch(current, dx, dy, dz, r, gx, gy, gz, count))
+    return;
+  GradientScalar(current, dx, dy, dz, r, gx, gy, gz, 0, count);
+}
+
+bool Poly6Batch(const Params &p, const float *r2, float *w, int count) {
+  switch (activeLevel) {
+#ifdef KERNEL_X86
+  case SimdLevel::AVX512:
+    Poly6AVX512(p, r2, w, count);
+    return true;
+  case SimdLevel::AVX2:
+    Poly6AVX2(p, r2, w, count);
+    return true;
+  case SimdLevel::SSE:
+    Poly6SSE(p, r2, w, count);
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+bool SpikyGradientBatch(const Params &p, const float *dx, const float *dy,
+                        const float *dz, const float *r, float *gx, float *gy,
+                        float *gz, int count) {
+  switch (activeLevel) {
+#ifdef KERNEL_X86
+  case SimdLevel::AVX512:
+    SpikyGradAVX512(p, dx, dy, dz, r, gx, gy, gz, count);
+    return true;
+  case SimdLevel::AVX2:
+    SpikyGradAVX2(p, dx, dy, dz, r, gx, gy, gz, count);
+    return true;
+  case SimdLevel::SSE:
+    SpikyGradSSE(p, dx, dy, dz, r, gx, gy, gz, count);
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+SimdLevel getSimdLevel() { return activeLevel; }
+
+void SetSimdLevel(SimdLevel level) {
+  activeLevel = (int)level <= (int)supportedLevel ? level : supportedLevel;
+}
 
-  // Result = normalized * (coeff * diff * diff)
-  float scalar = coeff * diff * diff;
-  glm_vec3_scale(normalized, scalar, dest);
+const char *getSimdLevelName(SimdLevel level) {
+  static const char *names[] = {"Scalar", "SSE2", "AVX2", "AVX-512"};
+  return names[(int)level];
 }
 } // namespace Kernel
@@ -2,20 +2,239 @@
 #define KERNELS_H
 
 #include <cglm/cglm.h>
+#include <cmath>
 
 namespace Kernel {
-// Smoothing Radius Constants
-extern float h;
-extern float h2;
-extern float h9;
-extern float h6; // For SpikyGrad
-
-// Poly6 Kernel (For Density)
-float Poly6(float rSquared);
-
-// Spiky Kernel Gradient (For Pressure Force)
-// Writes result to 'dest'
-void SpikyGrad(vec3 rVector, float rLen, vec3 dest);
+// Smoothing kernel shapes. Poly6 / Spiky is the classic Müller pair; the
+// cubic spline and Wendland C2 are smoother at the support edge and give
+// the same quality of estimate with a smaller radius (fewer neighbors).
+enum class Family { Poly6Spiky, CubicSpline, WendlandC2, Count };
+
+// A. Constants
+// Everything here is constexpr, so a radius known at compile time folds
+// down to literals; the runtime path calls the same functions, so both
+// agree to the bit.
+constexpr double PI = 3.14159265358979323846;
+
+constexpr double IPow(double x, int n) {
+  return n == 0 ? 1.0 : x * IPow(x, n - 1);
+}
+
+// Density kernel normalization: W integrates to 1 over the support
+constexpr float DensityCoeff(Family f, float h) {
+  return f == Family::Poly6Spiky    ? (float)(315.0 / (64.0 * PI * IPow(h, 9)))
+         : f == Family::CubicSpline ? (float)(8.0 / (PI * IPow(h, 3)))
+                                    : (float)(21.0 / (2.0 * PI * IPow(h, 3)));
+}
+
+// Gradient factor, see GradScale below
+constexpr float GradCoeff(Family f, float h) {
+  return f == Family::Poly6Spiky    ? (float)(-45.0 / (PI * IPow(h, 6)))
+         : f == Family::CubicSpline ? (float)(8.0 / (PI * IPow(h, 5)))
+                                    : (float)(-210.0 / (PI * IPow(h, 5)));
+}
+
+// Support radius h and the constants derived from it
+struct Params {
+  Family family;
+  float h;
+  float h2;
+  float invH;
+  float densityCoeff;
+  float gradCoeff;
+};
+
+constexpr Params MakeParams(Family f, float h) {
+  return Params{f, h, h * h, 1.0f / h, DensityCoeff(f, h), GradCoeff(f, h)};
+}
+
+// B. Evaluation, with the family fixed at compile time
+// W(r^2); 0 outside [0, h^2]
+template <Family F> inline float DensityOf(const Params &p, float r2) {
+  if (!(r2 >= 0.0f && r2 <= p.h2))
+    return 0.0f;
+  if (F == Family::Poly6Spiky) {
+    float diff = p.h2 - r2;
+    return p.densityCoeff * (diff * diff * diff);
+  }
+  float q = std::sqrt(r2) * p.invH;
+  float t = 1.0f - q;
+  if (F == Family::CubicSpline)
+    return p.densityCoeff *
+           (q <= 0.5f ? 6.0f * (q * q * q - q * q) + 1.0f : 2.0f * t * t * t);
+  return p.densityCoeff * (t * t * t * t) * (1.0f + 4.0f * q);
+}
+
+// s(r) with GradW(rVector) = rVector * s, where r = |rVector|; 0 outside
+// (0, h]. Folding 1/r into s means the direction is never renormalized.
+template <Family F> inline float GradScaleOf(const Params &p, float r) {
+  if (!(r > 0.0f && r <= p.h))
+    return 0.0f;
+  if (F == Family::Poly6Spiky) {
+    float diff = p.h - r;
+    return p.gradCoeff * diff * diff / r;
+  }
+  float q = r * p.invH;
+  float t = 1.0f - q;
+  if (F == Family::CubicSpline)
+    return p.gradCoeff *
+           (q <= 0.5f ? 18.0f * q - 12.0f : -6.0f * t * t / q);
+  return p.gradCoeff * (t * t * t);
+}
+
+// Kernel at a radius fixed at compile time (in thousandths, as float
+// template arguments are not allowed), e.g. Fixed<Family::Poly6Spiky,
+// 1000>::Density(r2) compiles to the polynomial with literal constants
+template <Family F, int RadiusMilli> struct Fixed {
+  static constexpr Params params() {
+    return MakeParams(F, RadiusMilli / 1000.0f);
+  }
+  static float Density(float r2) { return DensityOf<F>(params(), r2); }
+  static float GradScale(float r) { return GradScaleOf<F>(params(), r); }
+  static void Gradient(const vec3 rVector, float rLen, vec3 dest) {
+    float scale = GradScale(rLen);
+    dest[0] = rVector[0] * scale;
+    dest[1] = rVector[1] * scale;
+    dest[2] = rVector[2] * scale;
+  }
+  // Same contract as the runtime batches below
+  static void DensityBatch(const float *r2, float *w, int count);
+  static void GradientBatch(const float *dx, const float *dy, const float *dz,
+                            const float *r, float *gx, float *gy, float *gz,
+                            int count);
+};
+
+// The radius the scene is tuned for
+typedef Fixed<Family::Poly6Spiky, 1000> Standard;
+
+// C. Runtime kernel
+// Family and radius used by the simulation. Changing either recomputes all
+// constants together; the engine rebuilds its neighbor lists on the next
+// step.
+const Params &Current();
+void SetRadius(float h);
+void SetFamily(Family family);
+const char *getFamilyName(Family family);
+
+// Current kernel at a single point
+float Density(float r2);
+// Writes GradW(rVector) to 'dest'; rLen = |rVector|, already known to the
+// caller
+void Gradient(const vec3 rVector, float rLen, vec3 dest);
+
+// Batched entry points: 'count' neighbor pairs per call, inputs and outputs
+// as separate arrays. Same results as the single-point functions on every
+// instruction set (no FMA, same operation order).
+// Pairs per batch the SPH loops gather before calling in
+const int BATCH = 16;
+
+// w[k] = Density(r2[k])
+void DensityBatch(const float *r2, float *w, int count);
+// (gx, gy, gz)[k] = Gradient((dx, dy, dz)[k], r[k]); the outputs may be the
+// input arrays (in-place)
+void GradientBatch(const float *dx, const float *dy, const float *dz,
+                   const float *r, float *gx, float *gy, float *gz,
+                   int count);
+
+// Poly6 / Spiky batches with the given constants on the active instruction
+// set. Return false without writing anything at the scalar level, where the
+// caller's own loop does as well.
+bool Poly6Batch(const Params &p, const float *r2, float *w, int count);
+bool SpikyGradientBatch(const Params &p, const float *dx, const float *dy,
+                        const float *dz, const float *r, float *gx, float *gy,
+                        float *gz, int count);
+
+// Instruction set used by the batched kernels, picked at startup from what
+// the CPU supports. Only Poly6 / Spiky has vector paths; the other
+// families run the scalar loop.
+enum class SimdLevel { Scalar, SSE, AVX2, AVX512 };
+SimdLevel getSimdLevel();
+// Use a lower level (for A/B timing); levels the CPU lacks are ignored
+void SetSimdLevel(SimdLevel level);
+const char *getSimdLevelName(SimdLevel level);
+
+// D. Kernels for the SPH passes
+// The passes are templates on a kernel type K providing params(),
+// Density(), Gradient(), DensityBatch() and GradientBatch(). With a Fixed
+// kernel the family and every constant are compiled into the pass; Runtime
+// goes through Current() and picks the family on each call.
+template <Family F, int RadiusMilli>
+inline void Fixed<F, RadiusMilli>::DensityBatch(const float *r2, float *w,
+                                                int count) {
+  if (F == Family::Poly6Spiky && Poly6Batch(params(), r2, w, count))
+    return;
+  for (int k = 0; k < count; k++)
+    w[k] = Density(r2[k]);
+}
+
+template <Family F, int RadiusMilli>
+inline void Fixed<F, RadiusMilli>::GradientBatch(
+    const float *dx, const float *dy, const float *dz, const float *r,
+    float *gx, float *gy, float *gz, int count) {
+  if (F == Family::Poly6Spiky &&
+      SpikyGradientBatch(params(), dx, dy, dz, r, gx, gy, gz, count))
+    return;
+  for (int k = 0; k < count; k++) {
+    float scale = GradScale(r[k]);
+    gx[k] = dx[k] * scale;
+    gy[k] = dy[k] * scale;
+    gz[k] = dz[k] * scale;
+  }
+}
+
+// Fallback for radii without a Fixed instantiation
+struct Runtime {
+  static const Params &params() { return Current(); }
+  static float Density(float r2) { return Kernel::Density(r2); }
+  static void Gradient(const vec3 rVector, float rLen, vec3 dest) {
+    Kernel::Gradient(rVector, rLen, dest);
+  }
+  static void DensityBatch(const float *r2, float *w, int count) {
+    Kernel::DensityBatch(r2, w, count);
+  }
+  static void GradientBatch(const float *dx, const float *dy, const float *dz,
+                            const float *r, float *gx, float *gy, float *gz,
+                            int count) {
+    Kernel::GradientBatch(dx, dy, dz, r, gx, gy, gz, count);
+  }
+};
+
+// Tries each radius in turn, Runtime when none is the current one
+template <Family F, int... RadiiMilli> struct RadiusDispatch;
+
+template <Family F> struct RadiusDispatch<F> {
+  template <typename Step> static void Run(Step &step) {
+    step.template Run<Runtime>();
+  }
+};
+
+template <Family F, int RadiusMilli, int... More>
+struct RadiusDispatch<F, RadiusMilli, More...> {
+  template <typename Step> static void Run(Step &step) {
+    if (Current().h == Fixed<F, RadiusMilli>::params().h)
+      step.template Run<Fixed<F, RadiusMilli>>();
+    else
+      RadiusDispatch<F, More...>::Run(step);
+  }
+};
+
+// Calls step.Run<K>() once with the Fixed kernel of the current family at
+// the current radius if it is one of the standard radii, with Runtime
+// otherwise. The constants of a Fixed kernel are the ones SetRadius()
+// computes for that radius, so both choices give the same results.
+template <typename Step> void Dispatch(Step &step) {
+  // Standard radii, in thousandths
+  switch (Current().family) {
+  case Family::CubicSpline:
+    RadiusDispatch<Family::CubicSpline, 1000>::Run(step);
+    return;
+  case Family::WendlandC2:
+    RadiusDispatch<Family::WendlandC2, 1000>::Run(step);
+    return;
+  default:
+    RadiusDispatch<Family::Poly6Spiky, 1000>::Run(step);
+  }
+}
 } // namespace Kernel
 
 #endif
@@ -0,0 +1,156 @@
+#include "NeighborList.h"
+#include <algorithm>
+#include <functional>
+
+namespace {
+// visit(j) for every active particle within the radius of particle i
+template <typename Visitor>
+void ForEachInRange(const SpatialGrid &grid, const ParticleStore &particles,
+                    size_t i, float radius2, Visitor &&visit) {
+  const float *p = particles.position(i);
+  grid.ForEachNeighbor(p, [&](int j) {
+    if (!particles.isActive(j))
+      return;
+    const float *n = particles.position(j);
+    float dx = p[0] - n[0], dy = p[1] - n[1], dz = p[2] - n[2];
+    if (dx * dx + dy * dy + dz * dz < radius2)
+      visit(j);
+  });
+}
+} // namespace
+
+NeighborList::NeighborList() {}
+
+NeighborList::~NeighborList() {}
+
+void NeighborList::Build(const SpatialGrid &grid,
+                         const ParticleStore &particles, size_t count,
+                         float radius, ThreadPool *pool) {
+  const float radius2 = radius * radius;
+  const int blocks = (int)((count + BLOCK - 1) / BLOCK);
+  offsets.resize(count + 1);
+  blockMax.assign(blocks, -1);
+
+  // One thread: append in a single pass, no need to count first
+  if (!pool || pool->getThreadCount() == 1) {
+    neighbors.clear(); // Keeps capacity, so steady state does not allocate
+    offsets[0] = 0;
+    for (size_t i = 0; i < count; ++i) {
+      int &maxJ = blockMax[i / BLOCK];
+      if (particles.isActive(i))
+        ForEachInRange(grid, particles, i, radius2, [&](int j) {
+          neighbors.push_back(j);
+          maxJ = std::max(maxJ, j);
+        });
+      offsets[i + 1] = (int)neighbors.size();
+    }
+    return;
+  }
+
+  // 1. Count: offsets[i] holds particle i's list length for now
+  blockStart.resize(blocks + 1);
+  pool->ParallelForDynamic(blocks, 1, [&](int begin, int end, int) {
+    for (int b = begin; b < end; ++b) {
+      size_t first = (size_t)b * BLOCK;
+      size_t last = std::min(first + BLOCK, count);
+      int total = 0, maxJ = -1;
+      for (size_t i = first; i < last; ++i) {
+        int n = 0;
+        if (particles.isActive(i))
+          ForEachInRange(grid, particles, i, radius2, [&](int j) {
+            n++;
+            maxJ = std::max(maxJ, j);
+          });
+        offsets[i] = n;
+        total += n;
+      }
+      blockStart[b + 1] = total;
+      blockMax[b] = maxJ;
+    }
+  });
+
+  // 2. Prefix over the block totals
+  blockStart[0] = 0;
+  for (int b = 0; b < blocks; ++b)
+    blockStart[b + 1] += blockStart[b];
+  neighbors.resize(blockStart[blocks]); // Keeps capacity between steps
+  offsets[count] = blockStart[blocks];
+
+  // 3. Fill, each block from its own start
+  pool->ParallelForDynamic(blocks, 1, [&](int begin, int end, int) {
+    for (int b = begin; b < end; ++b) {
+      size_t first = (size_t)b * BLOCK;
+      size_t last = std::min(first + BLOCK, count);
+      int cursor = blockStart[b];
+      for (size_t i = first; i < last; ++i) {
+        int n = offsets[i];
+        offsets[i] = cursor;
+        if (n > 0)
+          ForEachInRange(grid, particles, i, radius2,
+                         [&](int j) { neighbors[cursor++] = j; });
+      }
+    }
+  });
+}
+
+void NeighborList::AddPairs(size_t count,
+                            const std::vector<std::pair<int, int>> &pairs) {
+  // Both directions of every pair, as (slot, neighbor), grouped by slot
+  std::vector<std::pair<int, int>> added;
+  added.reserve(pairs.size() * 2);
+  for (const auto &p : pairs) {
+    added.push_back(p);
+    if (p.first != p.second)
+      added.emplace_back(p.second, p.first);
+  }
+  std::stable_sort(added.begin(), added.end(),
+                   [](const std::pair<int, int> &a,
+                      const std::pair<int, int> &b) {
+                     return a.first < b.first;
+                   });
+
+  const int oldTotal = offsets.empty() ? 0 : offsets.back();
+  const int total = oldTotal + (int)added.size();
+  offsets.resize(count + 1, oldTotal); // New slots start empty
+  offsets[count] = total;
+  neighbors.resize(total);
+  blockMax.resize((count + BLOCK - 1) / BLOCK, -1);
+  for (const auto &a : added)
+    blockMax[a.first / BLOCK] = std::max(blockMax[a.first / BLOCK], a.second);
+
+  // Walk back from the last slot, moving each old range up by the number
+  // of entries added after it, until nothing is left to add
+  int write = total;
+  int oldEnd = oldTotal;
+  size_t next = added.size();
+  for (size_t i = count; i-- > 0 && next > 0;) {
+    while (next > 0 && added[next - 1].first == (int)i)
+      neighbors[--write] = added[--next].second;
+    int oldBegin = offsets[i];
+    std::copy_backward(neighbors.begin() + oldBegin,
+                       neighbors.begin() + oldEnd, neighbors.begin() + write);
+    write -= oldEnd - oldBegin;
+    offsets[i] = write;
+    oldEnd = oldBegin;
+  }
+}
+
+void NeighborList::Clear() {
+  std::vector<int>().swap(offsets);
+  std::vector<int>().swap(neighbors);
+  std::vector<int>().swap(blockStart);
+  std::vector<int>().swap(blockMax);
+}
+
+int NeighborList::getMaxNeighbor(size_t begin, size_t end) const {
+  int maxJ = -1;
+  for (size_t b = begin / BLOCK; b < blockMax.size() && b * BLOCK < end; ++b)
+    maxJ = std::max(maxJ, blockMax[b]);
+  return maxJ;
+}
+
+size_t NeighborList::getEntryCount() const { return neighbors.size(); }
+
+size_t NeighborList::getMemoryBytes() const {
+  return (offsets.capacity() + neighbors.capacity()) * sizeof(int);
+}
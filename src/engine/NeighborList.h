@@ -0,0 +1,72 @@
+#ifndef NEIGHBORLIST_H
+#define NEIGHBORLIST_H
+
+#include "../particle/ParticleStore.h"
+#include "SpatialGrid.h"
+#include "ThreadPool.h"
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Per-step neighbor lists in CSR layout.
+// The in-radius neighbors of particle i are
+// neighbors[offsets[i]] .. neighbors[offsets[i + 1] - 1]. A particle is in
+// its own list (r = 0), inactive particles have an empty range.
+class NeighborList {
+public:
+  NeighborList();
+  ~NeighborList();
+
+  // Gather the grid candidates of every active particle in slots
+  // [0, count) once and keep the ones closer than 'radius'.
+  // With a multi-threaded pool it runs in three passes over blocks of
+  // slots spread over the threads: count each particle's neighbors,
+  // prefix-sum the block totals, then fill. The lists come out the same
+  // as the single-pass serial build.
+  void Build(const SpatialGrid &grid, const ParticleStore &particles,
+             size_t count, float radius, ThreadPool *pool = nullptr);
+
+  // Grow the lists to slots [0, count) and add each (i, j) in 'pairs' to
+  // both particles' lists (once when i == j). Slots past the old count
+  // start empty. Existing entries keep their order, the new ones follow
+  // them; everything after the lowest touched slot is shifted in place.
+  void AddPairs(size_t count, const std::vector<std::pair<int, int>> &pairs);
+
+  // Drop the lists and release their memory
+  void Clear();
+
+  // Visit the cached neighbors of particle i: visit(int index)
+  template <typename Visitor> void ForEach(size_t i, Visitor &&visit) const {
+    const int *it = neighbors.data() + offsets[i];
+    const int *end = neighbors.data() + offsets[i + 1];
+    for (; it != end; ++it)
+      visit(*it);
+  }
+
+  // Raw CSR access, for passes that keep per-entry data alongside the lists:
+  // particle i's entries are [getOffset(i), getOffset(i + 1))
+  int getOffset(size_t i) const { return offsets[i]; }
+  const int *getIndices() const { return neighbors.data(); }
+
+  // Largest neighbor index in the lists of slots [begin, end), -1 if they
+  // are empty. Kept per block of slots, so it may also count the other
+  // slots of the first and last block.
+  int getMaxNeighbor(size_t begin, size_t end) const;
+
+  // Number of stored (i, j) entries
+  size_t getEntryCount() const;
+
+  // Bytes held by the offset and index arrays (capacity, not size, since the
+  // buffers are kept between steps)
+  size_t getMemoryBytes() const;
+
+private:
+  static const int BLOCK = 512; // Slots per block
+
+  std::vector<int> offsets;     // slot count + 1
+  std::vector<int> neighbors;   // concatenated neighbor indices
+  std::vector<int> blockStart;  // First entry of each block
+  std::vector<int> blockMax;    // Largest neighbor index of each block
+};
+
+#endif
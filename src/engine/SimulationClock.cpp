@@ -0,0 +1,65 @@
+#include "SimulationClock.h"
+#include "Kernels.h"
+#include "SteamEngine.h"
+#include <algorithm>
+#include <cmath>
+
+float SimulationClock::StableDt(const SteamEngine &engine) const {
+  const MotionStats &motion = engine.getMotionStats();
+  const float h = Kernel::Current().h;
+
+  float dt = maxDt;
+  if (motion.maxSpeed > 0.0f)
+    dt = std::min(dt, cflNumber * h / motion.maxSpeed);
+  if (motion.maxAcceleration > 0.0f)
+    dt = std::min(dt, forceNumber * std::sqrt(h / motion.maxAcceleration));
+  return std::max(dt, minDt);
+}
+
+float SimulationClock::TimeToNextStep(const SteamEngine &engine) const {
+  if (mode == ClockMode::Variable)
+    return 0.0f;
+  float dt = mode == ClockMode::Fixed ? fixedDt : StableDt(engine);
+  return std::max(dt - accumulator, 0.0f);
+}
+
+int SimulationClock::Advance(SteamEngine &engine, float frameTime) {
+  frameTime = std::min(std::max(frameTime, 0.0f), maxFrameTime);
+  stats.substeps = 0;
+  stats.simulatedTime = 0.0f;
+  stats.droppedTime = 0.0f;
+  stats.stableDt = StableDt(engine);
+
+  if (mode == ClockMode::Variable) {
+    accumulator = 0.0f;
+    engine.Update(frameTime);
+    stats.dt = frameTime;
+    stats.substeps = 1;
+    stats.simulatedTime = frameTime;
+    return 1;
+  }
+
+  accumulator += frameTime;
+  for (;;) {
+    // Re-derived every substep, the previous one may have sped things up
+    float dt = mode == ClockMode::Fixed ? fixedDt : StableDt(engine);
+    if (accumulator < dt)
+      break; // Carried to the next frame
+    if (stats.substeps == maxSubsteps) {
+      // Falling behind: run slower than real time instead of spending
+      // ever longer frames catching up
+      stats.droppedTime = accumulator;
+      stats.cappedFrames++;
+      accumulator = 0.0f;
+      break;
+    }
+
+    engine.Update(dt);
+    accumulator -= dt;
+    stats.dt = dt;
+    stats.stableDt = StableDt(engine);
+    stats.substeps++;
+    stats.simulatedTime += dt;
+  }
+  return stats.substeps;
+}
@@ -0,0 +1,62 @@
+#ifndef SIMULATIONCLOCK_H
+#define SIMULATIONCLOCK_H
+
+class SteamEngine;
+
+// How the clock turns frame time into engine steps
+enum class ClockMode {
+  Variable, // One step per frame with the frame's delta (the old behavior)
+  Fixed,    // Steps of fixedDt; leftover time carries to the next frame
+  Adaptive  // Largest step the CFL and force limits allow, up to maxDt
+};
+
+// What the most recent Advance did
+struct ClockStats {
+  float dt = 0.0f;          // Step size used (last substep)
+  float stableDt = 0.0f;    // Limit from the CFL / force conditions
+  int substeps = 0;         // Engine steps run this frame
+  float simulatedTime = 0.0f;
+  float droppedTime = 0.0f; // Frame time discarded by the substep cap
+  long cappedFrames = 0;    // Frames that hit maxSubsteps, in total
+};
+
+// Drives SteamEngine::Update from the frame clock. Frame time goes into an
+// accumulator and is consumed in substeps, so a slow frame runs several
+// normal-sized steps instead of one huge one, and a fast frame may run
+// none. The stable step comes from the previous step's fastest particle:
+//   dt <= cflNumber * h / maxSpeed           (move less than a kernel)
+//   dt <= forceNumber * sqrt(h / maxAccel)   (accelerate less than one)
+class SimulationClock {
+public:
+  // Run the substeps for 'frameTime' seconds of wall time; returns how
+  // many were run
+  int Advance(SteamEngine &engine, float frameTime);
+
+  // Largest step the conditions above allow for the engine's last step,
+  // clamped to [minDt, maxDt]
+  float StableDt(const SteamEngine &engine) const;
+
+  // Wall time until Advance would run a step again (0 in Variable mode)
+  float TimeToNextStep(const SteamEngine &engine) const;
+
+  // Forget the carried-over time (after a pause or a reset)
+  void Reset() { accumulator = 0.0f; }
+
+  const ClockStats &getStats() const { return stats; }
+
+  // SETTINGS (Public for UI)
+  ClockMode mode = ClockMode::Adaptive;
+  float fixedDt = 1.0f / 120.0f;
+  float cflNumber = 0.4f;
+  float forceNumber = 0.25f;
+  float minDt = 1.0f / 1000.0f;
+  float maxDt = 1.0f / 60.0f;
+  int maxSubsteps = 8;       // Per frame; the rest of the frame is dropped
+  float maxFrameTime = 0.25f; // Longer frames (window drags) are clamped
+
+private:
+  float accumulator = 0.0f;
+  ClockStats stats;
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include "SimulationThread.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+void SimulationSettings::CaptureFrom(const SteamEngine &engine,
+                                     const SimulationClock &clock) {
+  gravity = engine.gravity;
+  buoyancyCoeff = engine.buoyancyCoeff;
+  coolingRate = engine.coolingRate;
+  emissionRate = engine.emissionRate;
+  spawnRange = engine.getSpawnRange();
+  neighborMode = engine.neighborMode;
+  symmetricPairs = engine.symmetricPairs;
+  fusedPasses = engine.fusedPasses;
+  reorderInterval = engine.reorderInterval;
+  gridCellsPerRadius = engine.gridCellsPerRadius;
+  incrementalGrid = engine.incrementalGrid;
+  verletSkin = engine.verletSkin;
+  pressureSolver = engine.pressureSolver;
+  solverTolerance = engine.solverTolerance;
+  solverMaxIterations = engine.solverMaxIterations;
+  solverWarmStart = engine.solverWarmStart;
+  integrator = engine.integrator;
+  drag = engine.drag;
+  threadCount = engine.getThreadCount();
+
+  kernelFamily = Kernel::Current().family;
+  kernelRadius = Kernel::Current().h;
+  simdLevel = Kernel::getSimdLevel();
+
+  clockMode = clock.mode;
+  fixedDt = clock.fixedDt;
+  cflNumber = clock.cflNumber;
+  maxDt = clock.maxDt;
+  maxSubsteps = clock.maxSubsteps;
+}
+
+void SimulationSettings::ApplyTo(SteamEngine &engine,
+                                 SimulationClock &clock) const {
+  engine.gravity = gravity;
+  engine.buoyancyCoeff = buoyancyCoeff;
+  engine.coolingRate = coolingRate;
+  engine.emissionRate = emissionRate;
+  engine.SetSpawnRange(spawnRange);
+  engine.neighborMode = neighborMode;
+  engine.symmetricPairs = symmetricPairs;
+  engine.fusedPasses = fusedPasses;
+  engine.reorderInterval = reorderInterval;
+  engine.gridCellsPerRadius = gridCellsPerRadius;
+  engine.incrementalGrid = incrementalGrid;
+  engine.verletSkin = verletSkin;
+  engine.pressureSolver = pressureSolver;
+  engine.solverTolerance = solverTolerance;
+  engine.solverMaxIterations = solverMaxIterations;
+  engine.solverWarmStart = solverWarmStart;
+  engine.integrator = integrator;
+  engine.drag = drag;
+  if (threadCount != engine.getThreadCount())
+    engine.SetThreadCount(threadCount);
+
+  if (kernelFamily != Kernel::Current().family)
+    Kernel::SetFamily(kernelFamily);
+  if (kernelRadius != Kernel::Current().h)
+    Kernel::SetRadius(kernelRadius);
+  if (simdLevel != Kernel::getSimdLevel())
+    Kernel::SetSimdLevel(simdLevel);
+
+  if (clockMode != clock.mode)
+    clock.Reset();
+  clock.mode = clockMode;
+  clock.fixedDt = fixedDt;
+  clock.cflNumber = cflNumber;
+  clock.maxDt = maxDt;
+  clock.maxSubsteps = maxSubsteps;
+}
+
+SimulationThread::SimulationThread(SteamEngine &simEngine,
+                                   SimulationClock &simClock)
+    : engine(simEngine), clock(simClock), middle(1) {}
+
+SimulationThread::~SimulationThread() { Stop(); }
+
+void SimulationThread::Start(const SimulationSettings &settings) {
+  if (thread.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(settingsMutex);
+    pending = settings;
+    pendingChanged = true;
+    stopping = false;
+  }
+  thread = std::thread(&SimulationThread::Run, this);
+}
+
+void SimulationThread::Stop() {
+  if (!thread.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(settingsMutex);
+    stopping = true;
+  }
+  settingsCv.notify_all();
+  thread.join();
+}
+
+void SimulationThread::Submit(const SimulationSettings &settings) {
+  {
+    std::lock_guard<std::mutex> lock(settingsMutex);
+    pending = settings;
+    pendingChanged = true;
+  }
+  settingsCv.notify_all();
+}
+
+const SimulationSnapshot &SimulationThread::Acquire() {
+  if (middle.load(std::memory_order_acquire) & FRESH)
+    front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+  return slots[front];
+}
+
+void SimulationThread::Run() {
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point last = Clock::now();
+
+  for (;;) {
+    // 1. Step boundary: take the latest settings
+    bool changed;
+    {
+      std::lock_guard<std::mutex> lock(settingsMutex);
+      if (stopping)
+        return;
+      changed = pendingChanged;
+      if (changed)
+        applied = pending;
+      pendingChanged = false;
+    }
+    if (changed)
+      applied.ApplyTo(engine, clock);
+
+    if (applied.paused) {
+      std::unique_lock<std::mutex> lock(settingsMutex);
+      settingsCv.wait(lock, [&] { return stopping || pendingChanged; });
+      last = Clock::now(); // Paused time is not simulated
+      continue;
+    }
+
+    // 2. Catch up with wall time
+    Clock::time_point start = Clock::now();
+    float elapsed = std::chrono::duration<float>(start - last).count();
+    last = start;
+    int substeps = clock.Advance(engine, elapsed);
+    float advanceMs =
+        std::chrono::duration<float, std::milli>(Clock::now() - start)
+            .count();
+    if (substeps > 0)
+      Publish(advanceMs);
+
+    // 3. Sleep until the clock has a step's worth of time (or new settings).
+    // Variable mode runs one step per frame, so it waits for the render
+    // thread's next Submit, or maxFrameTime if none comes.
+    float wait = clock.mode == ClockMode::Variable
+                     ? clock.maxFrameTime
+                     : clock.TimeToNextStep(engine);
+    if (wait > 0.0f) {
+      std::unique_lock<std::mutex> lock(settingsMutex);
+      settingsCv.wait_for(lock, std::chrono::duration<float>(wait),
+                          [&] { return stopping || pendingChanged; });
+    }
+  }
+}
+
+void SimulationThread::Publish(float advanceMs) {
+  SimulationSnapshot &snap = slots[back];
+  const ParticleStore &ps = engine.getParticles();
+
+  // Pack the live particles; no holes means straight copies
+  int used = engine.getUsedSlots();
+  int live = engine.getActiveCount();
+  snap.particles.resize(live);
+  std::fill(snap.particles.active.begin(), snap.particles.active.end(), 1);
+  if (live == used) {
+    std::copy(ps.positions.begin(), ps.positions.begin() + used * 3,
+              snap.particles.positions.begin());
+    std::copy(ps.temperatures.begin(), ps.temperatures.begin() + used,
+              snap.particles.temperatures.begin());
+    std::copy(ps.ids.begin(), ps.ids.begin() + used,
+              snap.particles.ids.begin());
+  } else {
+    int out = 0;
+    for (int i = 0; i < used; i++) {
+      if (!ps.isActive(i))
+        continue;
+      std::copy(ps.position(i), ps.position(i) + 3,
+                snap.particles.position(out));
+      snap.particles.temperatures[out] = ps.temperatures[i];
+      snap.particles.ids[out] = ps.ids[i];
+      out++;
+    }
+  }
+  snap.activeCount = live;
+
+  simulatedTime += clock.getStats().simulatedTime;
+  snap.step = ++steps;
+  snap.simulatedTime = simulatedTime;
+  snap.advanceMs = advanceMs;
+
+  snap.clock = clock.getStats();
+  snap.motion = engine.getMotionStats();
+  snap.pressureSolver = engine.getPressureSolverStats();
+  for (int ph = 0; ph < (int)EnginePhase::Count; ph++)
+    snap.phases[ph] = engine.getPhaseStats((EnginePhase)ph);
+  snap.neighbors = engine.getNeighborStats();
+  snap.reorder = engine.getReorderStats();
+  snap.gridTuning = engine.getGridTuning();
+  snap.gridUpdate = engine.getGridUpdateStats();
+  snap.neighborListBytes = engine.getNeighborListBytes();
+  snap.neighborListEntries = engine.getNeighborListEntries();
+
+  snap.hasProbe = applied.probe;
+  if (applied.probe) {
+    snap.probeDensity = engine.SampleDensity(applied.probePosition);
+    int nearest;
+    float nearestDist2;
+    if (engine.FindNearest(applied.probePosition, 1, &nearest,
+                           &nearestDist2) > 0) {
+      snap.nearestId = (int)ps.ids[nearest];
+      snap.nearestDistance = std::sqrt(nearestDist2);
+    } else {
+      snap.nearestId = -1;
+    }
+  }
+  snap.hasGridDiagnostics = applied.gridDiagnostics;
+  if (applied.gridDiagnostics)
+    snap.gridDiagnostics = engine.getGridDiagnostics();
+
+  back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+}
@@ -0,0 +1,144 @@
+#ifndef SIMULATIONTHREAD_H
+#define SIMULATIONTHREAD_H
+
+#include "../particle/ParticleStore.h"
+#include "Kernels.h"
+#include "SimulationClock.h"
+#include "SteamEngine.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Everything the UI may change while the simulation runs. The UI edits its
+// own copy and submits it; the simulation thread copies it into the engine,
+// the kernel and the clock between two Advance calls, never mid-step.
+struct SimulationSettings {
+  // SteamEngine
+  float gravity = 0.0f;
+  float buoyancyCoeff = 0.0f;
+  float coolingRate = 0.0f;
+  float emissionRate = 0.0f;
+  float spawnRange = 0.0f;
+  NeighborMode neighborMode = NeighborMode::Recompute;
+  bool symmetricPairs = false;
+  bool fusedPasses = false;
+  int reorderInterval = 0;
+  int gridCellsPerRadius = 1;
+  bool incrementalGrid = false;
+  float verletSkin = 0.0f;
+  PressureSolver pressureSolver = PressureSolver::EquationOfState;
+  float solverTolerance = 0.0f;
+  int solverMaxIterations = 1;
+  bool solverWarmStart = true;
+  Integrator integrator = Integrator::SymplecticEuler;
+  float drag = 0.0f;
+  int threadCount = 0;
+
+  // Kernel
+  Kernel::Family kernelFamily = Kernel::Family::Poly6Spiky;
+  float kernelRadius = 1.0f;
+  Kernel::SimdLevel simdLevel = Kernel::SimdLevel::Scalar;
+
+  // SimulationClock
+  ClockMode clockMode = ClockMode::Adaptive;
+  float fixedDt = 0.0f;
+  float cflNumber = 0.0f;
+  float maxDt = 0.0f;
+  int maxSubsteps = 1;
+
+  bool paused = false;
+
+  // Probes, answered in the next snapshot
+  bool probe = false; // Density and nearest particle at probePosition
+  vec3 probePosition = {0.0f, 0.0f, 0.0f};
+  bool gridDiagnostics = false;
+
+  // Read the current values (before the thread starts)
+  void CaptureFrom(const SteamEngine &engine, const SimulationClock &clock);
+  // Write them back; setters that do more than store a value (thread
+  // count, kernel) only run when the value changed
+  void ApplyTo(SteamEngine &engine, SimulationClock &clock) const;
+};
+
+// Immutable result of one Advance, handed to the render thread
+struct SimulationSnapshot {
+  // Live particles packed at [0, activeCount): positions, temperatures and
+  // ids are filled in, the other fields are not
+  ParticleStore particles;
+  int activeCount = 0;
+  long step = 0; // Advance calls that ran at least one substep
+  double simulatedTime = 0.0;
+  float advanceMs = 0.0f; // Wall time of the Advance, substeps included
+
+  // Engine and clock stats as of this step
+  ClockStats clock;
+  MotionStats motion;
+  PressureSolverStats pressureSolver;
+  PhaseStats phases[(int)EnginePhase::Count];
+  NeighborStats neighbors;
+  ReorderStats reorder;
+  GridTuning gridTuning;
+  GridUpdateStats gridUpdate;
+  size_t neighborListBytes = 0;
+  size_t neighborListEntries = 0;
+
+  // Probe answers (see SimulationSettings)
+  bool hasProbe = false;
+  float probeDensity = 0.0f;
+  int nearestId = -1; // Particle id, -1 = none found
+  float nearestDistance = 0.0f;
+  bool hasGridDiagnostics = false;
+  GridDiagnostics gridDiagnostics;
+};
+
+// Runs SteamEngine on its own thread, paced by a SimulationClock against
+// wall time, and publishes a snapshot after every step through a triple
+// buffer: the simulation always has a free slot to write, the renderer
+// always gets the latest complete one, and neither side waits on the
+// other. Between Start and Stop only this thread touches the engine.
+class SimulationThread {
+public:
+  SimulationThread(SteamEngine &engine, SimulationClock &clock);
+  ~SimulationThread(); // Stops the thread
+
+  void Start(const SimulationSettings &settings);
+  void Stop();
+
+  // Applied at the next step boundary; cheap enough to call every frame.
+  // In Variable clock mode each call is also the frame tick that lets the
+  // next step run.
+  void Submit(const SimulationSettings &settings);
+
+  // Latest published snapshot. Stays valid and unchanged until the next
+  // call; before the first step it is empty (step 0).
+  const SimulationSnapshot &Acquire();
+
+private:
+  void Run();
+  void Publish(float advanceMs);
+
+  SteamEngine &engine;
+  SimulationClock &clock;
+  std::thread thread;
+
+  // Settings handoff
+  std::mutex settingsMutex;
+  std::condition_variable settingsCv; // Wakes a paused thread
+  SimulationSettings pending;
+  bool pendingChanged = false;
+  bool stopping = false;
+  SimulationSettings applied; // Simulation thread only
+
+  // Triple buffer. 'middle' holds the slot last published, with FRESH set
+  // until the reader takes it; the writer and reader own one slot each.
+  static const int FRESH = 4;
+  SimulationSnapshot slots[3];
+  std::atomic<int> middle;
+  int back = 0;  // Simulation thread
+  int front = 2; // Render thread
+  long steps = 0;
+  double simulatedTime = 0.0;
+};
+
+#endif
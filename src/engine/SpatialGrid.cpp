@@ -0,0 +1,550 @@
+#include "SpatialGrid.h"
+#include <algorithm>
+#include <cstdlib>
+
+SpatialGrid::SpatialGrid()
+    : cellSize(0.1f), invCellSize(10.0f), stencilRadius(1), useBounds(false),
+      dense(false), numCells(DEFAULT_TABLE_SIZE),
+      tableSize(DEFAULT_TABLE_SIZE), autoResize(true), incremental(false),
+      incrementalThreshold(0.25f), keysValid(false), queryStamp(0) {
+  glm_vec3_zero(boundsMin);
+  glm_vec3_zero(boundsExtent);
+  glm_vec3_zero(origin);
+  dims[0] = dims[1] = dims[2] = 0;
+  UpdateLayout();
+}
+
+void SpatialGrid::Build(const ParticleStore &particles, size_t count,
+                        ThreadPool *pool) {
+  // Keys depend on the table size, so size it from the previous build's
+  // count; populations change slowly next to the step rate
+  if (!dense && autoResize)
+    ResizeTableFor((int)sortedIndices.size());
+
+  if (incremental && UpdateIncremental(particles, (int)count, pool))
+    return;
+
+  // Per-thread histograms only pay off while they are small next to the
+  // particle array; with very fine dense grids the prefix sum would
+  // dominate.
+  int threads = pool ? pool->getThreadCount() : 1;
+  if (threads > 1 && count >= 4096 &&
+      (size_t)threads * numCells <= 2 * count)
+    BuildParallel(particles, (int)count, *pool);
+  else
+    BuildSerial(particles, (int)count);
+
+  updateStats.fullBuilds++;
+  keysValid = true;
+}
+
+void SpatialGrid::BuildSerial(const ParticleStore &particles, int count) {
+  // 1. Key every active particle and count the cell sizes.
+  // Counts go one slot to the right so the prefix sum below turns them
+  // straight into start offsets.
+  std::fill(cellStart.begin(), cellStart.end(), 0);
+  particleCell.resize(count);
+
+  int activeCount = 0;
+  for (int i = 0; i < count; ++i) {
+    if (!particles.isActive(i)) {
+      particleCell[i] = -1;
+      continue;
+    }
+    int id = GetGridIndex(particles.position(i));
+    particleCell[i] = id;
+    cellStart[id + 1]++;
+    activeCount++;
+  }
+
+  PrefixAndScatter(activeCount);
+}
+
+// Counting sort of the keys already in particleCell
+void SpatialGrid::SortFromKeys() {
+  std::fill(cellStart.begin(), cellStart.end(), 0);
+  int activeCount = 0;
+  for (size_t i = 0; i < particleCell.size(); ++i) {
+    int id = particleCell[i];
+    if (id < 0)
+      continue;
+    cellStart[id + 1]++;
+    activeCount++;
+  }
+  PrefixAndScatter(activeCount);
+}
+
+// Steps 2 and 3 of the serial counting sort, cellStart holds the counts
+void SpatialGrid::PrefixAndScatter(int activeCount) {
+  // 2. Prefix sum: cellStart[k] = first entry of cell k
+  for (int k = 0; k < numCells; ++k)
+    cellStart[k + 1] += cellStart[k];
+
+  // 3. Scatter. Walking the pool in order keeps each cell sorted by slot,
+  // so the layout is deterministic.
+  sortedIndices.resize(activeCount);
+  cellCursor.assign(cellStart.begin(), cellStart.end() - 1);
+  for (size_t i = 0; i < particleCell.size(); ++i) {
+    int id = particleCell[i];
+    if (id < 0)
+      continue;
+    sortedIndices[cellCursor[id]++] = (int)i;
+  }
+}
+
+// Re-key every slot, then only move the ones whose key changed (including
+// spawns, -1 -> key, and deaths, key -> -1). The cell list is rebuilt as a
+// merge of the entries that stayed, already in (cell, slot) order, with
+// the sorted movers, so the result equals a full build. Keys are per slot,
+// so particles that changed slots (compaction, reorder) are simply movers.
+// When the slot count changed, slots past the shorter of the two counts are
+// dead on one side. Returns false when a full build is needed instead.
+bool SpatialGrid::UpdateIncremental(
+    const ParticleStore &particles, int count, ThreadPool *pool) {
+  if (!keysValid)
+    return false;
+
+  // 1. New keys, in parallel when a pool is available
+  int slots = std::max(count, (int)particleCell.size());
+  particleCell.resize(slots, -1);
+  nextCell.resize(slots);
+  auto keyRange = [&](int begin, int end, int) {
+    for (int i = begin; i < end; ++i)
+      nextCell[i] = i < count && particles.isActive(i)
+                        ? GetGridIndex(particles.position(i))
+                        : -1;
+  };
+  if (pool)
+    pool->ParallelFor(slots, keyRange);
+  else
+    keyRange(0, slots, 0);
+
+  // 2. Collect the movers
+  int activeCount = 0, migrated = 0;
+  movers.clear();
+  for (int i = 0; i < slots; ++i) {
+    int key = nextCell[i];
+    if (key >= 0)
+      activeCount++;
+    if (key == particleCell[i])
+      continue;
+    migrated++;
+    if (key >= 0)
+      movers.push_back(std::make_pair(key, i));
+  }
+  updateStats.migrated = migrated;
+  updateStats.migratedFraction =
+      activeCount > 0 ? (float)migrated / (float)activeCount : 0.0f;
+
+  particleCell.swap(nextCell); // nextCell now holds the old keys
+  if (updateStats.migratedFraction > incrementalThreshold) {
+    particleCell.resize(count);
+    SortFromKeys();
+    updateStats.fullBuilds++;
+    return true;
+  }
+
+  // 3. Merge stayers and movers cell by cell, by slot inside a cell
+  std::sort(movers.begin(), movers.end());
+  mergedIndices.resize(activeCount);
+  int out = 0;
+  size_t m = 0;
+  int oldBegin = cellStart[0];
+  for (int k = 0; k < numCells; ++k) {
+    int oldEnd = cellStart[k + 1];
+    cellStart[k] = out;
+
+    int e = oldBegin;
+    for (;;) {
+      while (e < oldEnd && particleCell[sortedIndices[e]] != k)
+        e++; // Left this cell or died
+      bool haveOld = e < oldEnd;
+      bool haveNew = m < movers.size() && movers[m].first == k;
+      if (!haveOld && !haveNew)
+        break;
+      if (haveOld && (!haveNew || sortedIndices[e] < movers[m].second))
+        mergedIndices[out++] = sortedIndices[e++];
+      else
+        mergedIndices[out++] = movers[m++].second;
+    }
+    oldBegin = oldEnd;
+  }
+  cellStart[numCells] = out;
+  sortedIndices.swap(mergedIndices);
+  particleCell.resize(count); // Slots past count are all -1 by now
+
+  updateStats.incrementalUpdates++;
+  return true;
+}
+
+void SpatialGrid::BuildParallel(const ParticleStore &particles, int count,
+                                ThreadPool &pool) {
+  int threads = pool.getThreadCount();
+  particleCell.resize(count);
+  threadOffsets.assign((size_t)threads * numCells, 0);
+
+  // 1. Key and histogram: thread t counts its slice into row t
+  pool.ParallelFor(count, [&](int begin, int end, int t) {
+    int *hist = threadOffsets.data() + (size_t)t * numCells;
+    for (int i = begin; i < end; ++i) {
+      if (!particles.isActive(i)) {
+        particleCell[i] = -1;
+        continue;
+      }
+      int id = GetGridIndex(particles.position(i));
+      particleCell[i] = id;
+      hist[id]++;
+    }
+  });
+
+  // 2. Cell totals, then the prefix sum over cells
+  pool.ParallelFor(numCells, [&](int begin, int end, int) {
+    for (int c = begin; c < end; ++c) {
+      int total = 0;
+      for (int t = 0; t < threads; ++t)
+        total += threadOffsets[(size_t)t * numCells + c];
+      cellStart[c + 1] = total;
+    }
+  });
+  cellStart[0] = 0;
+  for (int k = 0; k < numCells; ++k)
+    cellStart[k + 1] += cellStart[k];
+
+  // 3. Turn the histograms into per-thread write cursors: inside a cell,
+  // thread t writes after threads 0 .. t-1, matching the serial slot order
+  pool.ParallelFor(numCells, [&](int begin, int end, int) {
+    for (int c = begin; c < end; ++c) {
+      int offset = cellStart[c];
+      for (int t = 0; t < threads; ++t) {
+        int &slot = threadOffsets[(size_t)t * numCells + c];
+        int n = slot;
+        slot = offset;
+        offset += n;
+      }
+    }
+  });
+
+  // 4. Scatter each slice through its own cursors
+  sortedIndices.resize(cellStart[numCells]);
+  pool.ParallelFor(count, [&](int begin, int end, int t) {
+    int *cursor = threadOffsets.data() + (size_t)t * numCells;
+    for (int i = begin; i < end; ++i) {
+      int id = particleCell[i];
+      if (id >= 0)
+        sortedIndices[cursor[id]++] = i;
+    }
+  });
+}
+
+void SpatialGrid::Clear() {
+  std::fill(cellStart.begin(), cellStart.end(), 0);
+  sortedIndices.clear();
+  keysValid = false;
+}
+
+void SpatialGrid::SetBounds(const vec3 minBounds, const vec3 maxBounds) {
+  useBounds = true;
+  glm_vec3_copy(const_cast<float *>(minBounds), boundsMin);
+  glm_vec3_sub(const_cast<float *>(maxBounds), const_cast<float *>(minBounds),
+               boundsExtent);
+  UpdateLayout();
+}
+
+void SpatialGrid::ClearBounds() {
+  useBounds = false;
+  UpdateLayout();
+}
+
+void SpatialGrid::setCellSize(float h) { SetSearchRadius(h, 1); }
+
+void SpatialGrid::SetSearchRadius(float radius, int cellsPerRadius) {
+  cellsPerRadius =
+      std::min(std::max(1, cellsPerRadius), (int)MAX_STENCIL_RADIUS);
+  float size = radius / cellsPerRadius;
+  if (size == cellSize && cellsPerRadius == stencilRadius &&
+      !forwardOffsets.empty())
+    return;
+
+  cellSize = size;
+  invCellSize = 1.0f / size;
+  stencilRadius = cellsPerRadius;
+  UpdateLayout();
+}
+
+// Pick dense or hashed keys for the current bounds and cell size, and size
+// the offset table to match. The cell list is empty until the next Build().
+void SpatialGrid::UpdateLayout() {
+  dense = false;
+  if (useBounds) {
+    long total = 1;
+    for (int a = 0; a < 3; ++a) {
+      dims[a] = std::max(1, (int)std::ceil(boundsExtent[a] * invCellSize));
+      total *= dims[a];
+    }
+    dense = total <= MAX_DENSE_CELLS;
+  }
+
+  if (dense) {
+    numCells = dims[0] * dims[1] * dims[2];
+    glm_vec3_copy(boundsMin, origin);
+  } else {
+    // Hashed keys are taken from world coordinates
+    numCells = tableSize;
+    glm_vec3_zero(origin);
+  }
+
+  cellStart.assign(numCells + 1, 0);
+  sortedIndices.clear();
+  keysValid = false;
+  bucketStamp.assign(dense ? 0 : numCells, 0u);
+  queryStamp = 0;
+
+  // Forward half of the stencil: offsets after (0, 0, 0) in z, y, x order.
+  // Together with their negations they make up the whole stencil.
+  forwardOffsets.clear();
+  const int r = stencilRadius;
+  for (int z = -r; z <= r; ++z)
+    for (int y = -r; y <= r; ++y)
+      for (int x = -r; x <= r; ++x)
+        if (z > 0 || (z == 0 && (y > 0 || (y == 0 && x > 0)))) {
+          forwardOffsets.push_back(x);
+          forwardOffsets.push_back(y);
+          forwardOffsets.push_back(z);
+        }
+}
+
+int SpatialGrid::PairUnitBoundary(int part, int parts) const {
+  int units = getPairUnitCount();
+  if (part >= parts)
+    return units;
+  long target = (long)sortedIndices.size() * part / parts;
+  if (!dense)
+    return (int)target;
+  // First cell whose slice starts at or after the target entry
+  return (int)(std::lower_bound(cellStart.begin(), cellStart.begin() + units,
+                                (int)target) -
+               cellStart.begin());
+}
+
+std::vector<int> SpatialGrid::GetNeighbors(const vec3 position) const {
+  std::vector<int> neighbors;
+  ForEachNeighborCell(position, [&neighbors](const int *begin, const int *end) {
+    neighbors.insert(neighbors.end(), begin, end);
+  });
+  return neighbors;
+}
+
+int SpatialGrid::GetGridIndex(const vec3 position) const {
+  int x, y, z;
+  GetCellCoords(position, x, y, z);
+  if (dense)
+    return (z * dims[1] + y) * dims[0] + x;
+  return HashCell(x, y, z);
+}
+
+int SpatialGrid::FindKNearest(const vec3 center, int k,
+                              const ParticleStore &particles,
+                              int *outIndices, float *outDist2,
+                              float slack) const {
+  const int total = (int)sortedIndices.size();
+  if (k <= 0 || total == 0)
+    return 0;
+  const int *indices = sortedIndices.data();
+  int found = 0;
+
+  // Insertion into the sorted output; k is small for picking and probes
+  auto offer = [&](int i) {
+    if (!particles.isActive(i))
+      return;
+    const float *pi = particles.position(i);
+    float dx = pi[0] - center[0];
+    float dy = pi[1] - center[1];
+    float dz = pi[2] - center[2];
+    float d2 = dx * dx + dy * dy + dz * dz;
+    if (found == k && d2 >= outDist2[k - 1])
+      return;
+    int pos = found < k ? found++ : k - 1;
+    for (; pos > 0 && outDist2[pos - 1] > d2; --pos) {
+      outIndices[pos] = outIndices[pos - 1];
+      outDist2[pos] = outDist2[pos - 1];
+    }
+    outIndices[pos] = i;
+    outDist2[pos] = d2;
+  };
+
+  int c[3];
+  GetCellCoords(center, c[0], c[1], c[2]);
+  unsigned stamp = dense ? 0 : NextQueryStamp();
+  int seen = 0; // Entries walked; buckets are walked once, so no repeats
+
+  auto visitCell = [&](int x, int y, int z) {
+    if (found == k) {
+      // Skip cells that cannot beat the current k-th result
+      float gx = AxisGap(center[0], x, 0);
+      float gy = AxisGap(center[1], y, 1);
+      float gz = AxisGap(center[2], z, 2);
+      float reach = std::sqrt(outDist2[k - 1]) + slack;
+      if (gx * gx + gy * gy + gz * gz > reach * reach)
+        return;
+    }
+    int id;
+    if (dense) {
+      id = (z * dims[1] + y) * dims[0] + x;
+    } else {
+      id = HashCell(x, y, z);
+      if (bucketStamp[id] == stamp)
+        return;
+      bucketStamp[id] = stamp;
+    }
+    for (int e = cellStart[id]; e < cellStart[id + 1]; ++e)
+      offer(indices[e]);
+    seen += cellStart[id + 1] - cellStart[id];
+  };
+
+  for (int r = 0;; ++r) {
+    // Once the rings hold more cells than there are particles, finishing
+    // with a scan of the cell list is cheaper (and bounds far-away queries)
+    double side = 2.0 * r + 1.0;
+    if (r > 0 && side * side * side > (double)total) {
+      found = 0;
+      for (int e = 0; e < total; ++e)
+        offer(indices[e]);
+      return found;
+    }
+
+    // Shell of cells at Chebyshev distance r from the center's cell
+    int lo[3], hi[3];
+    for (int a = 0; a < 3; ++a) {
+      lo[a] = c[a] - r;
+      hi[a] = c[a] + r;
+      if (dense) {
+        lo[a] = std::max(lo[a], 0);
+        hi[a] = std::min(hi[a], dims[a] - 1);
+      }
+    }
+    for (int z = lo[2]; z <= hi[2]; ++z) {
+      for (int y = lo[1]; y <= hi[1]; ++y) {
+        bool face = std::abs(z - c[2]) == r || std::abs(y - c[1]) == r;
+        if (face) {
+          for (int x = lo[0]; x <= hi[0]; ++x)
+            visitCell(x, y, z);
+        } else {
+          if (c[0] - r >= lo[0])
+            visitCell(c[0] - r, y, z);
+          if (r > 0 && c[0] + r <= hi[0])
+            visitCell(c[0] + r, y, z);
+        }
+      }
+    }
+
+    // Closest any unvisited cell can be: the nearest face of the ring box
+    // that still has cells beyond it
+    float bound = std::numeric_limits<float>::infinity();
+    for (int a = 0; a < 3; ++a) {
+      if (!dense || c[a] - r > 0)
+        bound = std::min(bound,
+                         center[a] - (origin[a] + (c[a] - r) * cellSize));
+      if (!dense || c[a] + r < dims[a] - 1)
+        bound = std::min(bound,
+                         origin[a] + (c[a] + r + 1) * cellSize - center[a]);
+    }
+    if (bound == std::numeric_limits<float>::infinity() || seen >= total)
+      return found; // Every cell (or particle) has been visited
+    bound -= slack;
+    if (found == k && bound > 0.0f && outDist2[k - 1] <= bound * bound)
+      return found;
+  }
+}
+
+namespace {
+bool IsPrime(int n) {
+  if (n < 2)
+    return false;
+  for (int d = 2; (long)d * d <= n; ++d)
+    if (n % d == 0)
+      return false;
+  return true;
+}
+} // namespace
+
+void SpatialGrid::ResizeTableFor(int particleCount) {
+  bool tooFull = (long)particleCount * 2 > tableSize;
+  bool tooEmpty =
+      tableSize > DEFAULT_TABLE_SIZE && (long)particleCount * 16 < tableSize;
+  if (!tooFull && !tooEmpty)
+    return;
+
+  int target = std::max(DEFAULT_TABLE_SIZE, 4 * particleCount);
+  while (!IsPrime(target))
+    target++;
+  tableSize = target;
+  UpdateLayout();
+}
+
+GridDiagnostics
+SpatialGrid::ComputeDiagnostics(const ParticleStore &particles,
+                                int sampleStride) const {
+  GridDiagnostics d;
+  d.dense = dense;
+  d.tableSize = numCells;
+  d.particles = (int)sortedIndices.size();
+  d.loadFactor = (float)d.particles / (float)numCells;
+
+  // 1. Occupancy
+  for (int k = 0; k < numCells; ++k) {
+    int len = cellStart[k + 1] - cellStart[k];
+    if (len > 0)
+      d.occupiedBuckets++;
+    d.maxBucketLength = std::max(d.maxBucketLength, len);
+
+    int bin = 0;
+    for (int limit = 1; len > limit && bin < 6; limit *= 2)
+      bin++;
+    if (len > 0)
+      bin++;
+    d.histogram[std::min(bin, GridDiagnostics::HISTOGRAM_BINS - 1)]++;
+  }
+
+  // 2. Sampled queries through the same walk the SPH passes use: an entry
+  // is a false candidate when its real cell is outside the stencil (it only
+  // shows up through a hash collision) and a duplicate when the query
+  // already handed it over
+  double ratioSum = 0.0;
+  std::vector<size_t> lastQuery(sortedIndices.size(), (size_t)-1);
+  sampleStride = std::max(1, sampleStride);
+  const int r = stencilRadius;
+  const int *indices = sortedIndices.data();
+  for (size_t s = 0; s < sortedIndices.size(); s += sampleStride) {
+    int i = sortedIndices[s];
+    int cx, cy, cz;
+    GetCellCoords(particles.position(i), cx, cy, cz);
+
+    long queryCandidates = 0, queryFalse = 0;
+    ForEachNeighborCell(particles.position(i), [&](const int *begin,
+                                                   const int *end) {
+      for (const int *it = begin; it != end; ++it) {
+        size_t e = it - indices;
+        if (lastQuery[e] == s)
+          d.duplicateCandidates++;
+        lastQuery[e] = s;
+
+        int jx, jy, jz;
+        GetCellCoords(particles.position(*it), jx, jy, jz);
+        queryCandidates++;
+        if (std::abs(jx - cx) > r || std::abs(jy - cy) > r ||
+            std::abs(jz - cz) > r)
+          queryFalse++;
+      }
+    });
+
+    d.sampledQueries++;
+    d.candidates += queryCandidates;
+    d.falseCandidates += queryFalse;
+    if (queryCandidates > 0)
+      ratioSum += (double)queryFalse / (double)queryCandidates;
+  }
+  if (d.sampledQueries > 0)
+    d.falseCandidateRatio = (float)(ratioSum / d.sampledQueries);
+
+  return d;
+}
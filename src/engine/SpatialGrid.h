@@ -1,118 +1,470 @@
 #ifndef SPATIALGRID_H
 #define SPATIALGRID_H
 
-#include "../particle/SteamParticle.h"
+#include "../particle/ParticleStore.h"
+#include "ThreadPool.h"
+#include <algorithm>
 #include <cglm/cglm.h>
+#include <cmath>
+#include <limits>
+#include <utility>
 #include <vector>
 
+// Occupancy and collision report, see SpatialGrid::ComputeDiagnostics
+struct GridDiagnostics {
+  static const int HISTOGRAM_BINS = 8;
+
+  bool dense = false;
+  int tableSize = 0; // Cell keys (buckets when hashed)
+  int particles = 0;
+  float loadFactor = 0.0f; // particles / tableSize
+  int occupiedBuckets = 0;
+  int maxBucketLength = 0;
+  // Bucket lengths binned as 0, 1, 2, 3-4, 5-8, 9-16, 17-32, 33+
+  int histogram[HISTOGRAM_BINS] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+  // Sampled stencil queries, run through ForEachNeighborCell itself
+  long sampledQueries = 0;
+  long candidates = 0;          // Entries handed to the visitor
+  long falseCandidates = 0;     // ... whose real cell is not in the stencil
+  long duplicateCandidates = 0; // ... already handed over by the same query
+  float falseCandidateRatio = 0.0f; // Mean per query
+};
+
+// Counters for SpatialGrid's build modes
+struct GridUpdateStats {
+  long fullBuilds = 0;
+  long incrementalUpdates = 0;
+  int migrated = 0;              // Slots whose key changed in the last build
+  float migratedFraction = 0.0f; // ... relative to the live particles
+};
+
+// Uniform grid stored as a compact cell list.
+// Active particle indices are sorted by cell key into one flat array
+// (sortedIndices), and cell key k owns the slice
+// [cellStart[k], cellStart[k + 1]). Build() is a counting sort, so there is
+// no per-cell heap storage and a cell lookup is two loads.
+//
+// Two key layouts:
+// - Dense (after SetBounds): one key per cell of the bounded box, x-major.
+//   Collision free, and particles outside the box are clamped into the
+//   border cells so nothing is lost.
+// - Hashed (default): cell coordinates hashed into a prime-sized table, for
+//   unbounded scenes. The table grows and shrinks with the particle count
+//   (see setAutoResize) so bucket chains stay short.
 class SpatialGrid {
 public:
-  SpatialGrid() : cellSize(0.1f) { grid.resize(TABLE_SIZE); }
+  SpatialGrid();
   ~SpatialGrid() {}
 
-  void Build(const std::vector<SteamParticle> &particles) {
-    Clear();
-    for (size_t i = 0; i < particles.size(); ++i) {
-      if (!particles[i].isActive())
-        continue; // Optional: skip inactive
-      int id = GetGridIndex(particles[i].position, cellSize);
-      grid[id].push_back(i);
-    }
+  // Counting sort of the active particles by cell key.
+  // With a pool, each thread histograms a contiguous slice of the particles
+  // and scatters it at offsets from a (cell, thread) prefix sum, so the
+  // result is the same as the serial build for any thread count.
+  void Build(const ParticleStore &particles,
+             ThreadPool *pool = nullptr) {
+    Build(particles, particles.size(), pool);
   }
+  // Only slots [0, count) are looked at; callers that keep their live
+  // particles packed at the front pass the packed size
+  void Build(const ParticleStore &particles, size_t count,
+             ThreadPool *pool = nullptr);
+
+  void Clear();
 
-  void Clear() {
-    for (auto &bucket : grid) {
-      bucket.clear();
+  // Switch to the dense layout covering [minBounds, maxBounds].
+  // Falls back to hashing while the box would need more than
+  // MAX_DENSE_CELLS at the current cell size.
+  void SetBounds(const vec3 minBounds, const vec3 maxBounds);
+  void ClearBounds(); // Back to the hashed layout
+  bool isDense() const { return dense; }
+
+  // Walk the stencil around a position (the cell the point is in and every
+  // cell within stencilRadius cells of it: 27 cells for radius 1, 125 for
+  // radius 2) and hand each cell to the visitor as a range:
+  // visit(const int *begin, const int *end). Nothing is allocated.
+  // In the dense layout neighboring x cells are adjacent in the cell list,
+  // so each stencil row arrives as a single range. In the hashed layout a
+  // bucket shared by several stencil cells arrives once, so every
+  // candidate is handed over exactly once either way.
+  template <typename CellVisitor>
+  void ForEachNeighborCell(const vec3 position, CellVisitor &&visit) const {
+    int cx, cy, cz;
+    GetCellCoords(position, cx, cy, cz);
+    const int *indices = sortedIndices.data();
+    const int r = stencilRadius;
+
+    if (dense) {
+      int x0 = std::max(cx - r, 0), x1 = std::min(cx + r, dims[0] - 1);
+      int y0 = std::max(cy - r, 0), y1 = std::min(cy + r, dims[1] - 1);
+      int z0 = std::max(cz - r, 0), z1 = std::min(cz + r, dims[2] - 1);
+      for (int z = z0; z <= z1; ++z) {
+        for (int y = y0; y <= y1; ++y) {
+          int row = (z * dims[1] + y) * dims[0];
+          visit(indices + cellStart[row + x0],
+                indices + cellStart[row + x1 + 1]);
+        }
+      }
+      return;
+    }
+
+    // Buckets already walked by this query. The bit mask answers "no" for
+    // almost every bucket; only a hit is checked against the list.
+    int visited[MAX_STENCIL_CELLS];
+    int numVisited = 0;
+    unsigned long long seen[VISIT_MASK_WORDS] = {};
+    for (int x = cx - r; x <= cx + r; ++x) {
+      for (int y = cy - r; y <= cy + r; ++y) {
+        for (int z = cz - r; z <= cz + r; ++z) {
+          int id = HashCell(x, y, z);
+          unsigned long long bit = 1ULL << (id & 63);
+          unsigned long long &word = seen[(id >> 6) % VISIT_MASK_WORDS];
+          if ((word & bit) && std::find(visited, visited + numVisited, id) !=
+                                  visited + numVisited)
+            continue; // Collision with a cell of this stencil
+          word |= bit;
+          visited[numVisited++] = id;
+          visit(indices + cellStart[id], indices + cellStart[id + 1]);
+        }
+      }
     }
   }
 
-  // Retrieve neighbors from the grid for a given position
-  // Checks the cell the particle is in and the 26 surrounding cells
-  std::vector<int> GetNeighbors(const vec3 position) {
-    std::vector<int> neighbors;
-    int cx = (int)(position[0] / cellSize);
-    int cy = (int)(position[1] / cellSize);
-    int cz = (int)(position[2] / cellSize);
-
-    for (int x = cx - 1; x <= cx + 1; ++x) {
-      for (int y = cy - 1; y <= cy + 1; ++y) {
-        for (int z = cz - 1; z <= cz + 1; ++z) {
-          // We need to manually invoke hash logic or refactor GetGridIndex to
-          // accept indices For simplicity, reusing GetGridIndex by
-          // reconstructing a test position or better, refactoring GetGridIndex
-          // to take grid coords.
-
-          // Let's refactor GetGridIndex to be usable here if possible,
-          // OR mostly just replicate the hash logic here for speed/access since
-          // GetGridIndex takes vec3.
-
-          long h1 = x * 73856093;
-          long h2 = y * 19349663;
-          long h3 = z * 83492791;
-
-          long hash = (h1 ^ h2 ^ h3) % TABLE_SIZE;
-          if (hash < 0)
-            hash += TABLE_SIZE;
-          int id = (int)hash;
-
-          const auto &bucket = grid[id];
-          neighbors.insert(neighbors.end(), bucket.begin(), bucket.end());
+  // Same walk, one candidate index at a time: visit(int index).
+  // Candidates are not distance-filtered; that is up to the caller.
+  template <typename Visitor>
+  void ForEachNeighbor(const vec3 position, Visitor &&visit) const {
+    ForEachNeighborCell(position, [&visit](const int *begin, const int *end) {
+      for (const int *it = begin; it != end; ++it)
+        visit(*it);
+    });
+  }
+
+  // Visit every candidate pair once: visit(int i, int j).
+  // Pairs come from the particle's own cell plus the "forward" half of the
+  // stencil (13 of 26 cells for radius 1, 62 of 124 for radius 2), so each
+  // unordered pair of particles in stencil range is seen exactly once.
+  // Candidates are not distance-filtered. 'particles' must be the array
+  // passed to Build().
+  template <typename PairVisitor>
+  void ForEachPair(const ParticleStore &particles, PairVisitor &&visit) const {
+    ForEachPairInRange(particles, 0, getPairUnitCount(), visit);
+  }
+
+  // The pair walk is made of units (cells when dense, cell list entries
+  // when hashed) that each own their pairs, so disjoint unit ranges can be
+  // walked by different threads. PairUnitBoundary(part, parts) splits the
+  // units into 'parts' ranges holding about the same number of particles.
+  int getPairUnitCount() const {
+    return dense ? numCells : (int)sortedIndices.size();
+  }
+  int PairUnitBoundary(int part, int parts) const;
+
+  template <typename PairVisitor>
+  void ForEachPairInRange(const ParticleStore &particles, int beginUnit,
+                          int endUnit, PairVisitor &&visit) const {
+    const int *indices = sortedIndices.data();
+    const int numForward = (int)forwardOffsets.size() / 3;
+    const int *offsets = forwardOffsets.data();
+
+    if (dense) {
+      // Walk the cells directly, every cell list entry is a real neighbor
+      for (int c = beginUnit; c < endUnit; ++c) {
+        const int *begin = indices + cellStart[c];
+        const int *end = indices + cellStart[c + 1];
+        if (begin == end)
+          continue;
+        int cx = c % dims[0];
+        int cy = (c / dims[0]) % dims[1];
+        int cz = c / (dims[0] * dims[1]);
+
+        for (const int *a = begin; a != end; ++a)
+          for (const int *b = a + 1; b != end; ++b)
+            visit(*a, *b);
+
+        for (int o = 0; o < numForward; ++o) {
+          int x = cx + offsets[o * 3 + 0];
+          int y = cy + offsets[o * 3 + 1];
+          int z = cz + offsets[o * 3 + 2];
+          if (x < 0 || x >= dims[0] || y < 0 || y >= dims[1] || z < 0 ||
+              z >= dims[2])
+            continue;
+          int n = (z * dims[1] + y) * dims[0] + x;
+          const int *nBegin = indices + cellStart[n];
+          const int *nEnd = indices + cellStart[n + 1];
+          for (const int *a = begin; a != end; ++a)
+            for (const int *b = nBegin; b != nEnd; ++b)
+              visit(*a, *b);
+        }
+      }
+      return;
+    }
+
+    // Hashed: a bucket can hold several cells, so go particle by particle
+    // and only accept entries whose real cell is the one being looked at.
+    for (int k = beginUnit; k < endUnit; ++k) {
+      int i = indices[k];
+      int cx, cy, cz;
+      GetCellCoords(particles.position(i), cx, cy, cz);
+
+      for (int o = -1; o < numForward; ++o) {
+        int x = cx, y = cy, z = cz;
+        if (o >= 0) {
+          x += offsets[o * 3 + 0];
+          y += offsets[o * 3 + 1];
+          z += offsets[o * 3 + 2];
+        }
+        int id = HashCell(x, y, z);
+        for (int e = cellStart[id]; e < cellStart[id + 1]; ++e) {
+          int j = indices[e];
+          if (o < 0 && j <= i)
+            continue; // Own cell: each pair from its lower index only
+          int jx, jy, jz;
+          GetCellCoords(particles.position(j), jx, jy, jz);
+          if (jx == x && jy == y && jz == z)
+            visit(i, j);
         }
       }
     }
-    return neighbors;
   }
 
-  // Retrieve neighbors from the grid for a given position
-  std::vector<int> GetNeighbors(vec3 position) {
-    std::vector<int> neighbors;
-    int cx = (int)(position[0] / cellSize);
-    int cy = (int)(position[1] / cellSize);
-    int cz = (int)(position[2] / cellSize);
-
-    for (int x = cx - 1; x <= cx + 1; ++x) {
-      for (int y = cy - 1; y <= cy + 1; ++y) {
-        for (int z = cz - 1; z <= cz + 1; ++z) {
-          long h1 = x * 73856093;
-          long h2 = y * 19349663;
-          long h3 = z * 83492791;
-
-          long hash = (h1 ^ h2 ^ h3) % TABLE_SIZE;
-          if (hash < 0)
-            hash += TABLE_SIZE;
-          int id = (int)hash;
-
-          const auto &bucket = grid[id];
-          neighbors.insert(neighbors.end(), bucket.begin(), bucket.end());
+  // Visit every active particle within 'radius' of 'center':
+  // visit(int index, float dist2). Any radius works, not just the
+  // stencil's; cells whose box lies farther than the radius are skipped.
+  // 'slack' widens the walk for particles that moved since Build() by up to
+  // that much (distances always use the current positions). Nothing is
+  // allocated. 'particles' must be the array passed to Build().
+  // Hashed queries mark visited buckets in a scratch array owned by the
+  // grid, so queries must not run concurrently with each other.
+  template <typename Visitor>
+  void ForEachInRadius(const vec3 center, float radius,
+                       const ParticleStore &particles,
+                       Visitor &&visit, float slack = 0.0f) const {
+    if (sortedIndices.empty() || radius < 0.0f)
+      return;
+    const float radius2 = radius * radius;
+    const float reach = radius + slack;
+    const float reach2 = reach * reach;
+    const int *indices = sortedIndices.data();
+
+    auto test = [&](int begin, int end) {
+      for (int e = begin; e < end; ++e) {
+        int i = indices[e];
+        if (!particles.isActive(i))
+          continue;
+        const float *pi = particles.position(i);
+        float dx = pi[0] - center[0];
+        float dy = pi[1] - center[1];
+        float dz = pi[2] - center[2];
+        float d2 = dx * dx + dy * dy + dz * dz;
+        if (d2 <= radius2)
+          visit(i, d2);
+      }
+    };
+
+    // Huge radii (or a sparse grid) touch more cells than there are
+    // particles: scanning the list is cheaper
+    float span[3];
+    for (int a = 0; a < 3; ++a)
+      span[a] = std::floor((center[a] + reach - origin[a]) * invCellSize) -
+                std::floor((center[a] - reach - origin[a]) * invCellSize) + 1;
+    if ((double)span[0] * span[1] * span[2] > (double)sortedIndices.size()) {
+      test(0, (int)sortedIndices.size());
+      return;
+    }
+
+    unsigned stamp = dense ? 0 : NextQueryStamp();
+    int z0 = AxisCell(center[2] - reach, 2), z1 = AxisCell(center[2] + reach, 2);
+    int y0 = AxisCell(center[1] - reach, 1), y1 = AxisCell(center[1] + reach, 1);
+    for (int z = z0; z <= z1; ++z) {
+      float gz = AxisGap(center[2], z, 2);
+      for (int y = y0; y <= y1; ++y) {
+        float gy = AxisGap(center[1], y, 1);
+        float rest2 = reach2 - gy * gy - gz * gz;
+        if (rest2 < 0.0f)
+          continue;
+        // Trim the row to the cells the sphere's slice actually reaches
+        float rest = std::sqrt(rest2);
+        int x0 = AxisCell(center[0] - rest, 0);
+        int x1 = AxisCell(center[0] + rest, 0);
+
+        if (dense) {
+          int row = (z * dims[1] + y) * dims[0];
+          test(cellStart[row + x0], cellStart[row + x1 + 1]);
+          continue;
+        }
+        for (int x = x0; x <= x1; ++x) {
+          int id = HashCell(x, y, z);
+          if (bucketStamp[id] == stamp)
+            continue; // Bucket already walked for another cell
+          bucketStamp[id] = stamp;
+          test(cellStart[id], cellStart[id + 1]);
         }
       }
     }
-    return neighbors;
   }
 
-  // Helper to allow Engine to set cell size (h)
-  void setCellSize(float h) { cellSize = h; }
+  // The k active particles closest to 'center', nearest first, written to
+  // outIndices / outDist2 (room for k entries each). Returns how many were
+  // found, fewer than k only when the grid holds fewer. Rings of cells are
+  // added around the center's cell until no unvisited cell can hold
+  // anything closer than the current k-th result. 'slack' and threading as
+  // for ForEachInRadius; nothing is allocated.
+  int FindKNearest(const vec3 center, int k,
+                   const ParticleStore &particles,
+                   int *outIndices, float *outDist2, float slack = 0.0f) const;
+
+  // Walk the whole table and a sample of stencil queries (every
+  // sampleStride-th particle in the cell list). Meant for debug UI, not the
+  // per-step path. 'particles' must be the array passed to Build().
+  GridDiagnostics
+  ComputeDiagnostics(const ParticleStore &particles,
+                     int sampleStride = 64) const;
+
+  // Hashed layout: resize the table to about four buckets per particle when
+  // the load leaves [1/16, 1/2]. Never below DEFAULT_TABLE_SIZE.
+  void setAutoResize(bool enabled) { autoResize = enabled; }
+  int getTableSize() const { return numCells; }
+
+  // Incremental mode: Build() re-keys every particle but only moves the ones
+  // whose cell changed, spawned or died, merging them into the existing
+  // cell list. Falls back to a full build when more than 'threshold' of the
+  // live particles migrated.
+  void setIncremental(bool enabled, float threshold = 0.25f) {
+    incremental = enabled;
+    incrementalThreshold = threshold;
+  }
+  const GridUpdateStats &getUpdateStats() const { return updateStats; }
+
+  // Convenience wrapper that copies the candidates into a new vector.
+  // Prefer ForEachNeighbor in per-particle loops.
+  std::vector<int> GetNeighbors(const vec3 position) const;
+
+  // Helper to allow Engine to set cell size (h), with a 27-cell stencil
+  void setCellSize(float h);
+
+  // Size the cells so the stencil covers 'radius': cells of
+  // radius / cellsPerRadius with a (2 * cellsPerRadius + 1)^3 stencil
+  // (cellsPerRadius is clamped to [1, MAX_STENCIL_RADIUS]).
+  // Smaller cells hug the search sphere tighter and visit fewer candidates,
+  // at the price of more cells to walk. Only re-lays out on a change.
+  void SetSearchRadius(float radius, int cellsPerRadius = 1);
+  float getCellSize() const { return cellSize; }
+  int getParticleCount() const { return (int)sortedIndices.size(); }
+  int getStencilRadius() const { return stencilRadius; }
 
 private:
-  static const int TABLE_SIZE = 10007; // Prime number for hashing
+  static const int DEFAULT_TABLE_SIZE = 10007; // Prime number for hashing
+  static const int MAX_DENSE_CELLS = 1 << 22; // 16 MB of cell offsets
+  static const int MAX_STENCIL_RADIUS = 3;     // Cells per search radius
+  static const int MAX_STENCIL_CELLS = (2 * MAX_STENCIL_RADIUS + 1) *
+                                       (2 * MAX_STENCIL_RADIUS + 1) *
+                                       (2 * MAX_STENCIL_RADIUS + 1);
+  static const int VISIT_MASK_WORDS = 16; // 1024-bit bucket filter
+
   float cellSize;
-  std::vector<std::vector<int>> grid;
-
-  int GetGridIndex(const vec3 position, float h) {
-    int x = (int)(position[0] / h);
-    int y = (int)(position[1] / h);
-    int z = (int)(position[2] / h);
-
-    // Large primes for hashing
-    long h1 = x * 73856093;
-    long h2 = y * 19349663;
-    long h3 = z * 83492791;
-
-    long hash = (h1 ^ h2 ^ h3) % TABLE_SIZE;
-    if (hash < 0)
-      hash += TABLE_SIZE;
-    return (int)hash;
+  float invCellSize;
+  int stencilRadius;               // Cells searched in each direction
+  std::vector<int> forwardOffsets; // Half of the stencil, xyz triples
+
+  // Dense layout
+  bool useBounds; // SetBounds() was called
+  bool dense;     // ... and the box fits in MAX_DENSE_CELLS
+  vec3 boundsMin;
+  vec3 boundsExtent;
+  vec3 origin; // Key origin: boundsMin when dense, zero when hashed
+  int dims[3];
+  int numCells;  // Cell keys in use: dense cell count or hash table size
+  int tableSize; // Hash table size (prime)
+  bool autoResize;
+
+  // Compact cell list
+  std::vector<int> cellStart;     // numCells + 1 cell offsets
+  std::vector<int> sortedIndices; // Particle indices grouped by cell
+  std::vector<int> particleCell;  // Cell key per built slot (-1 = inactive)
+  std::vector<int> cellCursor;    // Scatter cursors, reused between builds
+  std::vector<int> threadOffsets; // Per-thread histograms / cursors
+
+  // Incremental mode
+  bool incremental;
+  float incrementalThreshold;
+  bool keysValid; // particleCell matches the current cell list
+  std::vector<int> nextCell;
+  std::vector<int> mergedIndices;
+  std::vector<std::pair<int, int>> movers; // (new key, slot)
+  GridUpdateStats updateStats;
+
+  // Range / kNN queries: a bucket is walked once per query (hashed cells
+  // can share one), tracked by stamping it with the query's number
+  mutable std::vector<unsigned> bucketStamp;
+  mutable unsigned queryStamp;
+
+  void BuildSerial(const ParticleStore &particles, int count);
+  void SortFromKeys();
+  void PrefixAndScatter(int activeCount);
+  bool UpdateIncremental(const ParticleStore &particles, int count,
+                         ThreadPool *pool);
+  void BuildParallel(const ParticleStore &particles, int count,
+                     ThreadPool &pool);
+
+  void UpdateLayout();
+
+  // Floor-indexed cell coordinates (truncation would merge cells -1 and 0).
+  // Dense coordinates are clamped into the box.
+  void GetCellCoords(const vec3 position, int &x, int &y, int &z) const {
+    float fx = std::floor((position[0] - origin[0]) * invCellSize);
+    float fy = std::floor((position[1] - origin[1]) * invCellSize);
+    float fz = std::floor((position[2] - origin[2]) * invCellSize);
+    if (dense) {
+      fx = std::min(std::max(fx, 0.0f), (float)(dims[0] - 1));
+      fy = std::min(std::max(fy, 0.0f), (float)(dims[1] - 1));
+      fz = std::min(std::max(fz, 0.0f), (float)(dims[2] - 1));
+    }
+    x = (int)fx;
+    y = (int)fy;
+    z = (int)fz;
+  }
+  int GetGridIndex(const vec3 position) const;
+  // Cell coordinate of v along one axis, clamped like GetCellCoords
+  int AxisCell(float v, int axis) const {
+    float f = std::floor((v - origin[axis]) * invCellSize);
+    if (dense)
+      f = std::min(std::max(f, 0.0f), (float)(dims[axis] - 1));
+    return (int)f;
+  }
+  // Distance from v to cell 'c' along one axis. Dense border cells also hold
+  // the clamped particles outside the box, so they reach to infinity.
+  float AxisGap(float v, int c, int axis) const {
+    float lo = origin[axis] + c * cellSize;
+    float hi = lo + cellSize;
+    if (dense && c == 0)
+      lo = -std::numeric_limits<float>::infinity();
+    if (dense && c == dims[axis] - 1)
+      hi = std::numeric_limits<float>::infinity();
+    return v < lo ? lo - v : (v > hi ? v - hi : 0.0f);
+  }
+  unsigned NextQueryStamp() const {
+    if (++queryStamp == 0) { // Wrapped: forget every old mark
+      std::fill(bucketStamp.begin(), bucketStamp.end(), 0u);
+      queryStamp = 1;
+    }
+    return queryStamp;
+  }
+  // Pack 21 bits per axis and run a 64-bit finalizer. The classic
+  // x*p1 ^ y*p2 ^ z*p3 hash folds the room's cells onto far fewer distinct
+  // values, so it collides no matter how big the table is.
+  int HashCell(int x, int y, int z) const {
+    unsigned long long k = (unsigned long long)(x & 0x1fffff) |
+                           (unsigned long long)(y & 0x1fffff) << 21 |
+                           (unsigned long long)(z & 0x1fffff) << 42;
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return (int)(k % (unsigned long long)tableSize);
   }
+  void ResizeTableFor(int particleCount);
 };
 
 #endif
@@ -1,10 +1,22 @@
 #include "SteamEngine.h"
 #include "Kernels.h"
 #include <algorithm> // for std::max
+#include <chrono>
+#include <cmath>
 #include <iostream>
 
+namespace {
+// Particles per stealable range in the per-particle phases
+const int PARTICLE_GRAIN = 256;
+// Damping of the pressure solver's update. The Newton step only sees a
+// particle's own pressure; neighbors moving at once overshoot without it.
+const float SOLVER_RELAXATION = 0.5f;
+} // namespace
+
 SteamEngine::SteamEngine(float& spawn_range_mult)
-    : spawn_range_multiplier(spawn_range_mult) {
+    : threadPool(nullptr), spawn_range_multiplier(spawn_range_mult) {
+  SetThreadPool(nullptr);
+
   // Initialization
   // Gravity: Reduced from -9.8 to -0.5 to simulate air resistance/buoyancy
   gravity = -0.5f;
@@ -27,261 +39,1209 @@ void SteamEngine::Initialize(int maxParticles) {
   particlePool.clear();
   particlePool.resize(maxParticles); // Default constructor makes them inactive
 
-  // Fill the free list
-  deadParticleIndices.clear();
-  deadParticleIndices.reserve(maxParticles);
-  for (int i = 0; i < maxParticles; i++) {
-    deadParticleIndices.push_back(i);
+  liveEnd = activeCount = 0;
+  verletValid = false;
+}
+
+void SteamEngine::SetThreadPool(ThreadPool *pool) {
+  if (pool) {
+    threadPool = pool;
+    ownedPool.reset();
+    return;
   }
+  if (!ownedPool)
+    ownedPool.reset(new ThreadPool());
+  threadPool = ownedPool.get();
+}
+
+void SteamEngine::SetThreadCount(int numThreads) {
+  threadPool->SetThreadCount(numThreads);
+}
+
+int SteamEngine::getThreadCount() const {
+  return threadPool->getThreadCount();
 }
 
+const PhaseStats &SteamEngine::getPhaseStats(EnginePhase phase) const {
+  return phaseStats[(int)phase];
+}
+
+const char *SteamEngine::getPhaseName(EnginePhase phase) {
+  static const char *names[] = {"Density",   "Vorticity", "Forces",
+                                "Pressure",  "Integrate", "Thermodynamics"};
+  return names[(int)phase];
+}
+
+void SteamEngine::SetDomainBounds(const vec3 minBounds, const vec3 maxBounds) {
+  neighborGrid.SetBounds(minBounds, maxBounds);
+  verletValid = false; // Cell keys changed
+}
+
+// Hands the kernel Kernel::Dispatch picked to the SPH passes
+struct SteamEngine::KernelStep {
+  SteamEngine *engine;
+  float deltaTime;
+  template <typename K> void Run() { engine->CalculateSph<K>(deltaTime); }
+};
+
 void SteamEngine::Update(float deltaTime) {
-  SpawnParticles(deltaTime);
+  // Keep spatial neighbors close in memory. Slots move, so any lists built
+  // from the old layout are stale afterwards.
+  if (reorderInterval > 0 &&
+      ++reorderStats.stepsSinceReorder >= reorderInterval) {
+    ReorderParticles();
+    verletValid = false;
+  }
+
+  // Verlet lists stay valid as long as nobody moved more than half the skin.
+  // Particles spawned in between are inserted into the lists, so emission
+  // does not wait for the next rebuild.
+  bool rebuild = true;
+  if (neighborMode == NeighborMode::Verlet)
+    rebuild = NeedsVerletRebuild();
+  else
+    verletValid = false;
 
-  // SPH STEPS
-  neighborGrid.Build(particlePool);
-  CalculateDensityAndPressure();
-  CalculateVorticity(); // [NEW] Calculate curl of velocity
-  CalculateForces();    // Includes Gravity & Buoyancy
+  if (rebuild) {
+    // Slots move, so only between list builds
+    CompactParticles();
+    SpawnParticles(deltaTime);
+
+    // SPH STEPS
+    BuildNeighbors();
+  } else {
+    int first = liveEnd;
+    SpawnParticles(deltaTime);
+    InsertSpawned(first);
+  }
+
+  ResetPhase(EnginePhase::Pressure);
+  PredictVelocities();
+  KernelStep step = {this, deltaTime};
+  Kernel::Dispatch(step);
   Integrate(deltaTime);
 
   // STEAM LOGIC
   UpdateThermodynamics(deltaTime); // Cool down & Fade
 }
 
-const std::vector<SteamParticle> &SteamEngine::getParticles() const {
+const ParticleStore &SteamEngine::getParticles() const {
   return particlePool;
 }
 
-// A. Emission
+size_t SteamEngine::getNeighborListBytes() const {
+  size_t pairBytes = (pairJ.capacity() + pairEnd.capacity()) * sizeof(int) +
+                     (pairGradX.capacity() + pairGradY.capacity() +
+                      pairGradZ.capacity() + pairR.capacity()) *
+                         sizeof(float);
+  return neighborList.getMemoryBytes() + pairBytes;
+}
 
-// B. Density & Pressure Step
-void SteamEngine::CalculateDensityAndPressure() {
-  for (size_t i = 0; i < particlePool.size(); i++) {
-    SteamParticle &p = particlePool[i];
-    if (!p.active)
-      continue;
+size_t SteamEngine::getNeighborListEntries() const {
+  return neighborList.getEntryCount();
+}
+
+const NeighborStats &SteamEngine::getNeighborStats() const {
+  return neighborStats;
+}
+
+const ReorderStats &SteamEngine::getReorderStats() const {
+  return reorderStats;
+}
 
-    p.density = 0.0f;
-    p.density += p.mass * Kernel::Poly6(0.0f);
-    // 1. Get Neighbors
-    std::vector<int> neighbors = neighborGrid.GetNeighbors(p.position);
+const MotionStats &SteamEngine::getMotionStats() const { return motionStats; }
 
-    // 2. Sum Density
-    for (int j : neighbors) {
-      SteamParticle &n = particlePool[j];
-      if (!n.active)
-        continue; // Skip inactive neighbors too? usually yes.
+const PressureSolverStats &SteamEngine::getPressureSolverStats() const {
+  return solverStats;
+}
+
+namespace {
+// Spread the low 21 bits of v so there are two zero bits between each
+unsigned long long SpreadBits3(unsigned long long v) {
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffffULL;
+  v = (v | v << 16) & 0x1f0000ff0000ffULL;
+  v = (v | v << 8) & 0x100f00f00f00f00fULL;
+  v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+  v = (v | v << 2) & 0x1249249249249249ULL;
+  return v;
+}
+
+// Z-order key of the kernel-sized cell containing a position
+unsigned long long MortonKey(const vec3 position, float cellSize) {
+  const long bias = 1 << 20; // Cell coordinates can be negative
+  unsigned long long key = 0;
+  for (int a = 0; a < 3; ++a) {
+    long c = (long)std::floor(position[a] / cellSize) + bias;
+    key |= SpreadBits3((unsigned long long)c) << a;
+  }
+  return key;
+}
+} // namespace
 
-      vec3 distVec;
-      glm_vec3_sub(p.position, n.position, distVec);
-      float r2 = glm_vec3_norm2(distVec);
+void SteamEngine::ReorderParticles() {
+  auto start = std::chrono::high_resolution_clock::now();
+
+  // 1. Key the live particles (pair order breaks ties by slot)
+  reorderKeys.clear();
+  for (int i = 0; i < liveEnd; i++) {
+    if (particlePool.isActive(i))
+      reorderKeys.push_back(
+          std::make_pair(MortonKey(particlePool.position(i), Kernel::Current().h),
+                         i));
+  }
+  std::sort(reorderKeys.begin(), reorderKeys.end());
 
-      if (r2 < Kernel::h2) {
-        // Density = Sum(Mass * Kernel)
-        p.density += n.mass * Kernel::Poly6(r2);
+  // 2. Pack them at the front of the pool in key order
+  size_t liveCount = reorderKeys.size();
+  reorderOrder.resize(liveCount);
+  for (size_t k = 0; k < liveCount; k++)
+    reorderOrder[k] = reorderKeys[k].second;
+  reorderScratch.Gather(particlePool, reorderOrder.data(), liveCount);
+  particlePool.swap(reorderScratch);
+  liveEnd = (int)liveCount;
+
+  auto end = std::chrono::high_resolution_clock::now();
+  reorderStats.lastReorderMs =
+      std::chrono::duration<float, std::milli>(end - start).count();
+  reorderStats.reorders++;
+  reorderStats.stepsSinceReorder = 0;
+}
+
+const GridTuning &SteamEngine::getGridTuning() const { return gridTuning; }
+
+GridDiagnostics SteamEngine::getGridDiagnostics(int sampleStride) const {
+  return neighborGrid.ComputeDiagnostics(particlePool, sampleStride);
+}
+
+const GridUpdateStats &SteamEngine::getGridUpdateStats() const {
+  return neighborGrid.getUpdateStats();
+}
+
+void SteamEngine::RequestGridAutotune() {
+  gridTuning.pending = true;
+  gridTuning.done = false;
+}
+
+float SteamEngine::SearchRadius() const {
+  if (neighborMode == NeighborMode::Verlet)
+    return Kernel::Current().h + verletSkin;
+  return Kernel::Current().h;
+}
+
+float SteamEngine::QuerySlack() const {
+  // Lists are rebuilt once a particle has moved half the skin, and the step
+  // that triggers it moves them once more
+  if (neighborMode == NeighborMode::Verlet)
+    return verletSkin;
+  return 0.0f;
+}
+
+int SteamEngine::FindNearest(const vec3 center, int k, int *outIndices,
+                             float *outDist2) const {
+  return neighborGrid.FindKNearest(center, k, particlePool, outIndices,
+                                   outDist2, QuerySlack());
+}
+
+float SteamEngine::SampleDensity(const vec3 position) const {
+  float density = 0.0f;
+  ForEachInRadius(position, Kernel::Current().h, [&](int j, float r2) {
+    density += particlePool.masses[j] * Kernel::Density(r2);
+  });
+  return density;
+}
+
+// Times a grid build plus one neighbor sweep (the access pattern of a SPH
+// pass) for each resolution. Leaves the grid built with the winner.
+void SteamEngine::AutotuneGrid() {
+  float radius = SearchRadius();
+  float radius2 = radius * radius;
+  long inRange = 0;
+
+  for (int c = 1; c <= 2; ++c) {
+    neighborGrid.SetSearchRadius(radius, c);
+    float best = 1e30f;
+    for (int rep = 0; rep < 3; ++rep) {
+      auto start = std::chrono::high_resolution_clock::now();
+      neighborGrid.Build(particlePool, liveEnd, threadPool);
+      for (int i = 0; i < liveEnd; i++) {
+        if (!particlePool.isActive(i))
+          continue;
+        const float *pi = particlePool.position(i);
+        neighborGrid.ForEachNeighbor(pi, [&](int j) {
+          const float *pj = particlePool.position(j);
+          float dx = pi[0] - pj[0], dy = pi[1] - pj[1], dz = pi[2] - pj[2];
+          if (dx * dx + dy * dy + dz * dz < radius2)
+            inRange++;
+        });
       }
+      auto end = std::chrono::high_resolution_clock::now();
+      best = std::min(
+          best, std::chrono::duration<float, std::milli>(end - start).count());
     }
+    gridTuning.msPerConfig[c - 1] = best;
+  }
+
+  gridCellsPerRadius =
+      gridTuning.msPerConfig[1] < gridTuning.msPerConfig[0] ? 2 : 1;
+  gridTuning.chosenCellsPerRadius = gridCellsPerRadius;
+  gridTuning.pending = false;
+  gridTuning.done = inRange > 0;
 
-    // 3. Compute Pressure (Ideal Gas Law: P = k * rho * T)
-    p.density = std::max(p.density, 0.001f);
-    p.pressure = gasConstant * p.density * p.temperature;
+  neighborGrid.SetSearchRadius(radius, gridCellsPerRadius);
+  neighborGrid.Build(particlePool, liveEnd, threadPool);
+}
+
+void SteamEngine::BuildNeighbors() {
+  pairBoundsParts = 0;
+
+  // Cells derive from the kernel radius so the stencil always covers it
+  neighborGrid.SetSearchRadius(SearchRadius(), gridCellsPerRadius);
+  neighborGrid.setIncremental(incrementalGrid);
+  neighborGrid.Build(particlePool, liveEnd, threadPool);
+
+  if (gridTuning.pending &&
+      neighborGrid.getParticleCount() >= autotuneMinParticles)
+    AutotuneGrid();
+
+  if (!UsesNeighborList()) {
+    if (neighborList.getMemoryBytes() > 0)
+      neighborList.Clear(); // Switched back to Recompute, give the memory back
+    return;
+  }
+
+  if (neighborMode != NeighborMode::Verlet) {
+    neighborList.Build(neighborGrid, particlePool, liveEnd, SearchRadius(),
+                       threadPool);
+    return;
   }
+
+  // Verlet: list everything within h + skin and remember where it was
+  verletRadius = SearchRadius();
+  neighborList.Build(neighborGrid, particlePool, liveEnd, verletRadius,
+                     threadPool);
+  verletReference.assign(particlePool.positions.begin(),
+                         particlePool.positions.begin() + liveEnd * 3);
+  verletGridEnd = liveEnd;
+  verletValid = true;
+  neighborStats.stepsSinceRebuild = 0;
+  neighborStats.maxDisplacement = 0.0f;
 }
 
-// [NEW] Calculate Vorticity (Curl of Velocity)
-void SteamEngine::CalculateVorticity() {
-  for (size_t i = 0; i < particlePool.size(); i++) {
-    SteamParticle &p = particlePool[i];
-    if (!p.active)
+void SteamEngine::UpdatePairBounds(EnginePhase phase, int parts) {
+  pairBounds.resize(parts * 2);
+  pairBoundsParts = parts;
+
+  // The j > i half of part p's lists: from its first slot up to the
+  // largest neighbor
+  if (neighborMode != NeighborMode::Recompute) {
+    for (int p = 0; p < parts; p++) {
+      int begin = (int)((long)liveEnd * p / parts);
+      int end = (int)((long)liveEnd * (p + 1) / parts);
+      pairBounds[p * 2 + 0] = begin;
+      pairBounds[p * 2 + 1] =
+          std::max(end, neighborList.getMaxNeighbor(begin, end) + 1);
+    }
+    return;
+  }
+
+  // Grid cells hold any slots, so walk the pairs once
+  RunPhase(phase, parts, [&](int part, int, int) {
+    int lo = liveEnd, hi = 0;
+    ForEachPair(part, parts, [&](int i, int j) {
+      lo = std::min(lo, std::min(i, j));
+      hi = std::max(hi, std::max(i, j) + 1);
+    });
+    pairBounds[part * 2 + 0] = lo;
+    pairBounds[part * 2 + 1] = std::max(lo, hi);
+  });
+}
+
+bool SteamEngine::UsesNeighborList() const {
+  return neighborMode != NeighborMode::Recompute || fusedPasses ||
+         pressureSolver == PressureSolver::Iterative;
+}
+
+bool SteamEngine::NeedsVerletRebuild() {
+  neighborStats.verletSteps++;
+
+  // A new kernel radius or skin needs lists of the new size
+  if (!verletValid || verletReference.size() != (size_t)liveEnd * 3 ||
+      verletRadius != SearchRadius()) {
+    neighborStats.rebuilds++;
+    return true;
+  }
+
+  // Largest squared displacement of a live particle since the last build
+  float maxDisp2 = 0.0f;
+  for (int i = 0; i < liveEnd; i++) {
+    if (!particlePool.isActive(i))
       continue;
+    const float *p = particlePool.position(i);
+    float dx = p[0] - verletReference[i * 3 + 0];
+    float dy = p[1] - verletReference[i * 3 + 1];
+    float dz = p[2] - verletReference[i * 3 + 2];
+    maxDisp2 = std::max(maxDisp2, dx * dx + dy * dy + dz * dz);
+  }
+  neighborStats.maxDisplacement = std::sqrt(maxDisp2);
+  neighborStats.stepsSinceRebuild++;
+
+  float halfSkin = 0.5f * verletSkin;
+  if (maxDisp2 > halfSkin * halfSkin) {
+    neighborStats.rebuilds++;
+    neighborStats.displacementRebuilds++;
+    return true;
+  }
+  if (neighborStats.stepsSinceRebuild >= verletMaxSteps) {
+    neighborStats.rebuilds++;
+    neighborStats.ageRebuilds++;
+    return true;
+  }
+  return false;
+}
 
-    glm_vec3_zero(p.angularVelocity);
+void SteamEngine::InsertSpawned(int first) {
+  if (first == liveEnd)
+    return;
 
-    std::vector<int> neighbors = neighborGrid.GetNeighbors(p.position);
+  // Listed particles are up to maxDisplacement from their reference and may
+  // move half the skin from there before the next rebuild; the new ones
+  // start at theirs. Listing the new pairs out to verletRadius plus that
+  // drift keeps every pair that can come within h covered. The grid is as
+  // old as the lists, so its walk needs the same slack.
+  const float drift = neighborStats.maxDisplacement;
+  const float radius = verletRadius + drift;
+  const float radius2 = radius * radius;
+  insertPairs.clear();
+  for (int n = first; n < liveEnd; n++) {
+    const float *p = particlePool.position(n);
+    neighborGrid.ForEachInRadius(
+        p, radius, particlePool,
+        [&](int j, float) { insertPairs.emplace_back(j, n); }, drift);
 
-    for (int j : neighbors) {
-      SteamParticle &n = particlePool[j];
-      if (!n.active)
+    // Spawned since the grid was built, this step's up to n itself
+    for (int m = verletGridEnd; m <= n; m++) {
+      if (!particlePool.isActive(m))
         continue;
+      const float *q = particlePool.position(m);
+      float dx = p[0] - q[0], dy = p[1] - q[1], dz = p[2] - q[2];
+      if (dx * dx + dy * dy + dz * dz < radius2)
+        insertPairs.emplace_back(m, n);
+    }
+  }
+  neighborList.AddPairs(liveEnd, insertPairs);
+  pairBoundsParts = 0;
 
-      vec3 distVec;
-      glm_vec3_sub(p.position, n.position, distVec);
-      float r = glm_vec3_norm(distVec);
+  verletReference.insert(verletReference.end(),
+                         particlePool.positions.begin() + first * 3,
+                         particlePool.positions.begin() + liveEnd * 3);
+  verletValid = true; // AddParticle clears it for particles not listed
+}
 
-      if (r > 0.0001f && r < Kernel::h) {
-        // 1. Velocity Difference
-        vec3 v_diff;
-        glm_vec3_sub(n.velocity, p.velocity, v_diff);
+// A. Emission
 
-        // 2. Kernel Gradient (Spiky Gradient)
-        vec3 gradW;
-        Kernel::SpikyGrad(distVec, r, gradW);
+// B-C. SPH passes, with the kernel chosen by Update
+template <typename K> void SteamEngine::CalculateSph(float deltaTime) {
+  if (pressureSolver == PressureSolver::Iterative) {
+    CalculateDensityFused<K>(false);
+    CalculateForcesFused(false);
+    SolvePressure(deltaTime);
+  } else if (fusedPasses) {
+    CalculateDensityFused<K>();
+    CalculateForcesFused();
+  } else {
+    CalculateDensityAndPressure<K>();
+    CalculateVorticity<K>(); // [NEW] Calculate curl of velocity
+    CalculateForces<K>();    // Includes Gravity & Buoyancy
+  }
+}
 
-        // 3. Cross Product: (v_diff) x (gradW)
-        vec3 crossProd;
-        glm_vec3_cross(v_diff, gradW, crossProd);
+// B. Density & Pressure Step
+template <typename K> void SteamEngine::CalculateDensityAndPressure() {
+  ResetPhase(EnginePhase::Density);
+  ParticleStore &ps = particlePool;
+  const float h2 = K::params().h2;
+  RunPhase(EnginePhase::Density, liveEnd, [&](int begin, int end, int) {
+    for (int i = begin; i < end; i++) {
+      if (!ps.isActive(i))
+        continue;
 
-        // 4. Accumulate: Mass * Cross / Density
-        float scalar = n.mass / (n.density + 0.0001f);
+      const float *pi = ps.position(i);
+      float density = ps.masses[i] * K::Density(0.0f);
 
-        vec3 term;
-        glm_vec3_scale(crossProd, scalar, term);
-        glm_vec3_add(p.angularVelocity, term, p.angularVelocity);
-      }
+      // Neighbors in range, evaluated Kernel::BATCH at a time
+      float r2s[Kernel::BATCH], massesJ[Kernel::BATCH], w[Kernel::BATCH];
+      int batched = 0;
+      auto flush = [&]() {
+        K::DensityBatch(r2s, w, batched);
+        // 2. Density = Sum(Mass * Kernel), in neighbor order
+        for (int k = 0; k < batched; k++)
+          density += massesJ[k] * w[k];
+        batched = 0;
+      };
+
+      // 1. Visit Neighbors
+      ForEachNeighbor(i, [&](int j) {
+        if (!ps.isActive(j))
+          return; // Skip inactive neighbors too? usually yes.
+
+        const float *pj = ps.position(j);
+        float dx = pi[0] - pj[0], dy = pi[1] - pj[1], dz = pi[2] - pj[2];
+        float r2 = dx * dx + dy * dy + dz * dz;
+
+        if (r2 < h2) {
+          r2s[batched] = r2;
+          massesJ[batched] = ps.masses[j];
+          if (++batched == Kernel::BATCH)
+            flush();
+        }
+      });
+      if (batched > 0)
+        flush();
+
+      // 3. Compute Pressure (Ideal Gas Law: P = k * rho * T)
+      density = std::max(density, 0.001f);
+      ps.densities[i] = density;
+      ps.pressures[i] = gasConstant * density * ps.temperatures[i];
     }
+  }, PARTICLE_GRAIN);
+}
+
+// [NEW] Calculate Vorticity (Curl of Velocity)
+template <typename K> void SteamEngine::CalculateVorticity() {
+  ResetPhase(EnginePhase::Vorticity);
+  if (symmetricPairs) {
+    CalculateVorticityPairs<K>();
+    return;
   }
+
+  ParticleStore &ps = particlePool;
+  const float h = K::params().h;
+  RunPhase(EnginePhase::Vorticity, liveEnd, [&](int begin, int end, int) {
+    for (int i = begin; i < end; i++) {
+      if (!ps.isActive(i))
+        continue;
+
+      float *pi = ps.position(i);
+      float *vi = ps.velocity(i);
+      float *omega = ps.angularVelocity(i);
+      glm_vec3_zero(omega);
+
+      ForEachNeighbor(i, [&](int j) {
+        if (!ps.isActive(j))
+          return;
+
+        vec3 distVec;
+        glm_vec3_sub(pi, ps.position(j), distVec);
+        float r = glm_vec3_norm(distVec);
+
+        if (r > 0.0001f && r < h) {
+          // 1. Velocity Difference
+          vec3 v_diff;
+          glm_vec3_sub(ps.velocity(j), vi, v_diff);
+
+          // 2. Kernel Gradient (Spiky Gradient)
+          vec3 gradW;
+          K::Gradient(distVec, r, gradW);
+
+          // 3. Cross Product: (v_diff) x (gradW)
+          vec3 crossProd;
+          glm_vec3_cross(v_diff, gradW, crossProd);
+
+          // 4. Accumulate: Mass * Cross / Density
+          float scalar = ps.masses[j] / (ps.densities[j] + 0.0001f);
+
+          vec3 term;
+          glm_vec3_scale(crossProd, scalar, term);
+          glm_vec3_add(omega, term, omega);
+        }
+      });
+    }
+  }, PARTICLE_GRAIN);
+}
+
+// Half-shell variant: each pair once, equal and opposite contributions.
+// For particle j the pair term is (v_i - v_j) x GradW(x_j - x_i), which is
+// the same cross product as for i since both factors flip sign.
+template <typename K> void SteamEngine::CalculateVorticityPairs() {
+  ParticleStore &ps = particlePool;
+  const float h = K::params().h;
+  RunPhase(EnginePhase::Vorticity, liveEnd, [&](int begin, int end, int) {
+    for (int i = begin; i < end; i++)
+      if (ps.isActive(i))
+        glm_vec3_zero(ps.angularVelocity(i));
+  }, PARTICLE_GRAIN);
+
+  AccumulatePairs(EnginePhase::Vorticity, ps.angularVelocities,
+                  [&](int i, int j, float *omegaI, float *omegaJ) {
+    if (!ps.isActive(i) || !ps.isActive(j))
+      return;
+
+    vec3 distVec;
+    glm_vec3_sub(ps.position(i), ps.position(j), distVec);
+    float r = glm_vec3_norm(distVec);
+
+    if (r > 0.0001f && r < h) {
+      vec3 v_diff;
+      glm_vec3_sub(ps.velocity(j), ps.velocity(i), v_diff);
+
+      vec3 gradW;
+      K::Gradient(distVec, r, gradW);
+
+      vec3 crossProd;
+      glm_vec3_cross(v_diff, gradW, crossProd);
+
+      glm_vec3_muladds(crossProd, ps.masses[j] / (ps.densities[j] + 0.0001f),
+                       omegaI);
+      glm_vec3_muladds(crossProd, ps.masses[i] / (ps.densities[i] + 0.0001f),
+                       omegaJ);
+    }
+  });
+}
+
+// 1. Gravity & 2. Buoyancy
+void SteamEngine::ApplyBodyForces(size_t i) {
+  // Reset forces
+  float *force = particlePool.force(i);
+  glm_vec3_zero(force);
+
+  // 1. Gravity (Downwards)
+  force[1] += gravity * particlePool.masses[i];
+
+  // 2. Buoyancy (Upwards based on Temperature)
+  // Hotter particles rise faster.
+  float lift = buoyancyCoeff * particlePool.temperatures[i];
+  force[1] += lift;
 }
 
 // C. Force Accumulation
-void SteamEngine::CalculateForces() {
-  for (size_t i = 0; i < particlePool.size(); i++) {
-    SteamParticle &p = particlePool[i];
-    if (!p.active)
-      continue;
+template <typename K> void SteamEngine::CalculateForces() {
+  ResetPhase(EnginePhase::Forces);
+  if (symmetricPairs) {
+    CalculateForcesPairs<K>();
+    return;
+  }
+
+  ParticleStore &ps = particlePool;
+  const float h = K::params().h;
+  RunPhase(EnginePhase::Forces, liveEnd, [&](int begin, int end, int) {
+    for (int i = begin; i < end; i++) {
+      if (!ps.isActive(i))
+        continue;
+
+      ApplyBodyForces(i);
+
+      float *pi = ps.position(i);
+      float *force = ps.force(i);
+      float rho_i2 = ps.densities[i] * ps.densities[i];
+      float pressureTerm_i = ps.pressures[i] / rho_i2;
+
+      // Neighbors in range, evaluated Kernel::BATCH at a time
+      float dx[Kernel::BATCH], dy[Kernel::BATCH], dz[Kernel::BATCH];
+      float rs[Kernel::BATCH], scalars[Kernel::BATCH];
+      float gx[Kernel::BATCH], gy[Kernel::BATCH], gz[Kernel::BATCH];
+      int batched = 0;
+      auto flush = [&]() {
+        K::GradientBatch(dx, dy, dz, rs, gx, gy, gz, batched);
+        for (int k = 0; k < batched; k++) {
+          vec3 forceP = {gx[k] * scalars[k], gy[k] * scalars[k],
+                         gz[k] * scalars[k]};
+          glm_vec3_add(force, forceP, force);
+        }
+        batched = 0;
+      };
+
+      // 3. Pressure Force
+      ForEachNeighbor(i, [&](int j) {
+        if (i == j)
+          return;
+        if (!ps.isActive(j))
+          return;
+
+        vec3 diff;
+        glm_vec3_sub(pi, ps.position(j), diff);
+        float r = glm_vec3_norm(diff);
+
+        if (r < h && r > 0.0001f) {
+          // Symmetric Pressure Force
+          // F = - m_i * m_j * (P_i/rho_i^2 + P_j/rho_j^2) * GradW
+          float rho_j2 = ps.densities[j] * ps.densities[j];
+          float p_term = pressureTerm_i + (ps.pressures[j] / rho_j2);
+
+          dx[batched] = diff[0];
+          dy[batched] = diff[1];
+          dz[batched] = diff[2];
+          rs[batched] = r;
+          scalars[batched] = -ps.masses[i] * ps.masses[j] * p_term;
+          if (++batched == Kernel::BATCH)
+            flush();
+        }
+      });
+      if (batched > 0)
+        flush();
+
+      ApplyVorticityConfinement(i);
+    }
+  }, PARTICLE_GRAIN);
+}
+
+// Half-shell variant of the pressure force. GradW(x_j - x_i) is
+// -GradW(x_i - x_j), so particle j gets exactly the negated force.
+template <typename K> void SteamEngine::CalculateForcesPairs() {
+  ParticleStore &ps = particlePool;
+  const float h = K::params().h;
+  RunPhase(EnginePhase::Forces, liveEnd, [&](int begin, int end, int) {
+    for (int i = begin; i < end; i++)
+      if (ps.isActive(i))
+        ApplyBodyForces(i);
+  }, PARTICLE_GRAIN);
+
+  // 3. Pressure Force
+  AccumulatePairs(EnginePhase::Forces, ps.forces,
+                  [&](int i, int j, float *forceI, float *forceJ) {
+    if (!ps.isActive(i) || !ps.isActive(j))
+      return;
+
+    vec3 diff;
+    glm_vec3_sub(ps.position(i), ps.position(j), diff);
+    float r = glm_vec3_norm(diff);
 
-    // Reset forces
-    glm_vec3_zero(p.force);
+    if (r < h && r > 0.0001f) {
+      vec3 gradW;
+      K::Gradient(diff, r, gradW);
 
-    // 1. Gravity (Downwards)
-    p.force[1] += gravity * p.mass;
+      float rho_i2 = ps.densities[i] * ps.densities[i];
+      float rho_j2 = ps.densities[j] * ps.densities[j];
+      float p_term = (ps.pressures[i] / rho_i2) + (ps.pressures[j] / rho_j2);
 
-    // 2. Buoyancy (Upwards based on Temperature)
-    // Hotter particles rise faster.
-    float lift = buoyancyCoeff * p.temperature;
-    p.force[1] += lift;
+      vec3 forceP;
+      glm_vec3_scale(gradW, -ps.masses[i] * ps.masses[j] * p_term, forceP);
+      glm_vec3_add(forceI, forceP, forceI);
+      glm_vec3_sub(forceJ, forceP, forceJ);
+    }
+  });
+
+  RunPhase(EnginePhase::Forces, liveEnd, [&](int begin, int end, int) {
+    for (int i = begin; i < end; i++)
+      if (ps.isActive(i))
+        ApplyVorticityConfinement(i);
+  }, PARTICLE_GRAIN);
+}
+
+// 4. [NEW] Vorticity Confinement (Swirl Force)
+void SteamEngine::ApplyVorticityConfinement(size_t i) {
+  // Epsilon controls how "swirly" the steam is.
+  float epsilon = 0.5f;
+
+  // 1. Calculate magnitude of vorticity (how fast we are spinning)
+  float *omega = particlePool.angularVelocity(i);
+  float omegaLen = glm_vec3_norm(omega);
+  angularSpeeds[i] = omegaLen; // Render angle, in Integrate
+
+  // 2. Cheap "Curl Noise" Hack: Push perpendicular to velocity and spin axis
+  if (omegaLen > 0.0001f) {
+    vec3 N;
+    // Normalize vorticity to get axis of rotation
+    glm_vec3_scale(omega, 1.0f / omegaLen, N);
+
+    // 3. Force = epsilon * |Omega| * (N x v)
+    // This pushes the particle perpendicular to its motion, curving it.
+    vec3 swirlDir;
+    glm_vec3_cross(N, particlePool.velocity(i), swirlDir);
+
+    glm_vec3_scale(swirlDir, epsilon * omegaLen, swirlDir);
 
-    // 3. Pressure Force
-    std::vector<int> neighbors = neighborGrid.GetNeighbors(p.position);
-    for (int j : neighbors) {
-      if (i == (size_t)j)
+    glm_vec3_add(particlePool.force(i), swirlDir, particlePool.force(i));
+  }
+}
+
+// B+C. Fused pipeline
+// Positions do not move between the density and force passes, so the pair
+// geometry is worked out once. Sweep 1 needs only positions: density plus
+// GradW of every pair inside the kernel. Sweep 2 needs the densities of all
+// neighbors, so it waits for sweep 1; vorticity, pressure and confinement
+// of a particle then share one walk over its cached pairs. Contributions
+// are added in the same order as the three-pass pipeline, so the results
+// match it exactly.
+template <typename K>
+void SteamEngine::CalculateDensityFused(bool statePressure) {
+  ResetPhase(EnginePhase::Density);
+  ParticleStore &ps = particlePool;
+  const float h = K::params().h;
+  const float h2 = K::params().h2;
+  const int *indices = neighborList.getIndices();
+
+  size_t entries = neighborList.getEntryCount();
+  pairEnd.resize(liveEnd);
+  pairJ.resize(entries);
+  pairGradX.resize(entries);
+  pairGradY.resize(entries);
+  pairGradZ.resize(entries);
+  pairR.resize(entries);
+
+  RunPhase(EnginePhase::Density, liveEnd, [&](int begin, int end, int) {
+    for (int i = begin; i < end; i++) {
+      int first = neighborList.getOffset(i);
+      int last = neighborList.getOffset(i + 1);
+      pairEnd[i] = first;
+      if (!ps.isActive(i))
         continue;
-      SteamParticle &n = particlePool[j];
-      if (!n.active)
+
+      const float *pi = ps.position(i);
+      float density = ps.masses[i] * K::Density(0.0f);
+
+      float r2s[Kernel::BATCH], massesJ[Kernel::BATCH], w[Kernel::BATCH];
+      int batched = 0;
+      auto flush = [&]() {
+        K::DensityBatch(r2s, w, batched);
+        for (int k = 0; k < batched; k++)
+          density += massesJ[k] * w[k];
+        batched = 0;
+      };
+
+      // Difference vectors and lengths go straight into the cache and are
+      // turned into gradients in place below
+      int pairs = first;
+      for (int e = first; e < last; e++) {
+        int j = indices[e];
+        if (!ps.isActive(j))
+          continue; // Died since a Verlet build
+        const float *pj = ps.position(j);
+        float dx = pi[0] - pj[0], dy = pi[1] - pj[1], dz = pi[2] - pj[2];
+        float r2 = dx * dx + dy * dy + dz * dz;
+
+        if (r2 >= h2)
+          continue; // Skin entry (Verlet)
+
+        r2s[batched] = r2;
+        massesJ[batched] = ps.masses[j];
+        if (++batched == Kernel::BATCH)
+          flush();
+
+        float r = std::sqrt(r2);
+        if (r > 0.0001f && r < h) {
+          pairJ[pairs] = j;
+          pairGradX[pairs] = dx;
+          pairGradY[pairs] = dy;
+          pairGradZ[pairs] = dz;
+          pairR[pairs] = r;
+          pairs++;
+        }
+      }
+      if (batched > 0)
+        flush();
+
+      float *gx = pairGradX.data() + first;
+      float *gy = pairGradY.data() + first;
+      float *gz = pairGradZ.data() + first;
+      K::GradientBatch(gx, gy, gz, pairR.data() + first, gx, gy, gz,
+                            pairs - first);
+      pairEnd[i] = pairs;
+
+      density = std::max(density, 0.001f);
+      ps.densities[i] = density;
+      if (statePressure)
+        ps.pressures[i] = gasConstant * density * ps.temperatures[i];
+    }
+  }, PARTICLE_GRAIN);
+}
+
+void SteamEngine::CalculateForcesFused(bool pressureForces) {
+  ResetPhase(EnginePhase::Vorticity); // Folded into Forces
+  ResetPhase(EnginePhase::Forces);
+  ParticleStore &ps = particlePool;
+
+  RunPhase(EnginePhase::Forces, liveEnd, [&](int begin, int end, int) {
+    for (int i = begin; i < end; i++) {
+      if (!ps.isActive(i))
         continue;
 
-      vec3 diff;
-      glm_vec3_sub(p.position, n.position, diff);
-      float r = glm_vec3_norm(diff);
+      int first = neighborList.getOffset(i);
+      int last = pairEnd[i];
 
-      if (r < Kernel::h && r > 0.0001f) {
-        vec3 gradW;
-        Kernel::SpikyGrad(diff, r, gradW);
+      // Vorticity: Sum(Mass_j / Density_j * (v_j - v_i) x GradW)
+      float *vi = ps.velocity(i);
+      float *omega = ps.angularVelocity(i);
+      glm_vec3_zero(omega);
+      for (int e = first; e < last; e++) {
+        int j = pairJ[e];
+        vec3 gradW = {pairGradX[e], pairGradY[e], pairGradZ[e]};
 
-        // Symmetric Pressure Force
-        // F = - m_i * m_j * (P_i/rho_i^2 + P_j/rho_j^2) * GradW
-        float rho_i2 = p.density * p.density;
-        float rho_j2 = n.density * n.density;
-        float p_term = (p.pressure / rho_i2) + (n.pressure / rho_j2);
+        vec3 v_diff;
+        glm_vec3_sub(ps.velocity(j), vi, v_diff);
+        vec3 crossProd;
+        glm_vec3_cross(v_diff, gradW, crossProd);
 
-        vec3 forceP;
-        float scalar = -p.mass * n.mass * p_term;
-        glm_vec3_scale(gradW, scalar, forceP);
-        glm_vec3_add(p.force, forceP, p.force);
+        vec3 term;
+        glm_vec3_scale(crossProd, ps.masses[j] / (ps.densities[j] + 0.0001f),
+                       term);
+        glm_vec3_add(omega, term, omega);
+      }
+
+      ApplyBodyForces(i);
+
+      // Pressure: -m_i * m_j * (P_i/rho_i^2 + P_j/rho_j^2) * GradW
+      float *force = ps.force(i);
+      float pressureTerm_i =
+          ps.pressures[i] / (ps.densities[i] * ps.densities[i]);
+      for (int e = first; pressureForces && e < last; e++) {
+        int j = pairJ[e];
+        float rho_j2 = ps.densities[j] * ps.densities[j];
+        float p_term = pressureTerm_i + (ps.pressures[j] / rho_j2);
+        float scalar = -ps.masses[i] * ps.masses[j] * p_term;
+
+        vec3 forceP = {pairGradX[e] * scalar, pairGradY[e] * scalar,
+                       pairGradZ[e] * scalar};
+        glm_vec3_add(force, forceP, force);
       }
+
+      ApplyVorticityConfinement(i);
     }
+  }, PARTICLE_GRAIN);
+}
 
-    // 4. [NEW] Vorticity Confinement (Swirl Force)
-    // Epsilon controls how "swirly" the steam is.
-    float epsilon = 0.5f;
+// Implicit equation of state, solved predictor-corrector style (PCISPH).
+// The explicit pass sets p = k * rho * T from the current density, so a
+// large step lets particles run deep into each other before the pressure
+// notices. Here p is iterated towards k * rho* * T, where rho* is the
+// density the velocities under p would produce by the end of the step
+// (continuity equation over the cached GradW). Each iteration is a damped
+// Newton-Jacobi update: a particle's own pressure changes its predicted
+// density by -dt^2 / rho^2 * (|Sum m_j GradW|^2 + m_i Sum m_j |GradW|^2)
+// per unit, which keeps sparse particles (almost no such feedback) at the
+// explicit value and stiffens crowded ones.
+void SteamEngine::SolvePressure(float deltaTime) {
+  ParticleStore &ps = particlePool;
+  const float dt = deltaTime;
+  solverVelocity.resize(liveEnd * 3);
+  solverScale.resize(liveEnd);
 
-    // 1. Calculate magnitude of vorticity (how fast we are spinning)
-    float omegaLen = glm_vec3_norm(p.angularVelocity);
+  // 1. Newton step per unit of residual
+  RunPhase(EnginePhase::Pressure, liveEnd, [&](int begin, int end, int) {
+    for (int i = begin; i < end; i++) {
+      if (!ps.isActive(i))
+        continue;
+      float stiffness = gasConstant * std::max(ps.temperatures[i], 0.0f);
+      if (!solverWarmStart)
+        ps.pressures[i] = stiffness * ps.densities[i]; // Explicit value
 
-    // 2. Cheap "Curl Noise" Hack: Push perpendicular to velocity and spin axis
-    if (omegaLen > 0.0001f) {
-      vec3 N;
-      // Normalize vorticity to get axis of rotation
-      glm_vec3_scale(p.angularVelocity, 1.0f / omegaLen, N);
+      vec3 sum = {0.0f, 0.0f, 0.0f};
+      float sumSq = 0.0f;
+      for (int e = neighborList.getOffset(i); e < pairEnd[i]; e++) {
+        float mj = ps.masses[pairJ[e]];
+        vec3 gradW = {pairGradX[e], pairGradY[e], pairGradZ[e]};
+        glm_vec3_muladds(gradW, mj, sum);
+        sumSq += mj * glm_vec3_norm2(gradW);
+      }
+      float rho = ps.densities[i];
+      float feedback = dt * dt / (rho * rho) *
+                       (glm_vec3_norm2(sum) + ps.masses[i] * sumSq);
+      solverScale[i] = SOLVER_RELAXATION / (1.0f + stiffness * feedback);
+    }
+  }, PARTICLE_GRAIN);
 
-      // 3. Force = epsilon * |Omega| * (N x v)
-      // This pushes the particle perpendicular to its motion, curving it.
-      vec3 swirlDir;
-      glm_vec3_cross(N, p.velocity, swirlDir);
+  // Pressure acceleration: -Sum(m_j * (P_i/rho_i^2 + P_j/rho_j^2) * GradW)
+  auto pressureAccel = [&](int i, vec3 accel) {
+    glm_vec3_zero(accel);
+    float pressureTerm_i =
+        ps.pressures[i] / (ps.densities[i] * ps.densities[i]);
+    for (int e = neighborList.getOffset(i); e < pairEnd[i]; e++) {
+      int j = pairJ[e];
+      float rho_j2 = ps.densities[j] * ps.densities[j];
+      float scalar =
+          -ps.masses[j] * (pressureTerm_i + ps.pressures[j] / rho_j2);
+      vec3 gradW = {pairGradX[e], pairGradY[e], pairGradZ[e]};
+      glm_vec3_muladds(gradW, scalar, accel);
+    }
+  };
 
-      glm_vec3_scale(swirlDir, epsilon * omegaLen, swirlDir);
+  int threads = threadPool->getThreadCount();
+  const bool leapfrog = integrator == Integrator::Leapfrog;
+  const float kickTime = KickTime(dt);
+  solverStats = PressureSolverStats();
+  while (solverStats.iterations < solverMaxIterations) {
+    // 2. Velocities the positions will move with under the current
+    // pressures (as in Integrate)
+    RunPhase(EnginePhase::Pressure, liveEnd, [&](int begin, int end, int) {
+      for (int i = begin; i < end; i++) {
+        if (!ps.isActive(i))
+          continue;
+        vec3 accel;
+        pressureAccel(i, accel);
+        glm_vec3_muladds(ps.force(i), 1.0f / ps.masses[i], accel);
+        float *v = &solverVelocity[i * 3];
+        glm_vec3_copy(ps.velocity(i), v);
+        if (leapfrog) {
+          glm_vec3_muladds(ps.velocity(i), -drag, accel);
+          glm_vec3_sub(v, &predictorKick[i * 3], v);
+        }
+        glm_vec3_muladds(accel, kickTime, v);
+      }
+    }, PARTICLE_GRAIN);
 
-      glm_vec3_add(p.force, swirlDir, p.force);
+    // 3. Predicted density and pressure update. Static chunks, so the
+    // residual is summed in the same order for a given thread count.
+    chunkResidual.assign(threads, 0.0);
+    chunkPressure.assign(threads, 0.0);
+    RunPhase(EnginePhase::Pressure, liveEnd,
+             [&](int begin, int end, int chunk) {
+      double residualSum = 0.0, pressureSum = 0.0;
+      for (int i = begin; i < end; i++) {
+        if (!ps.isActive(i))
+          continue;
+        const float *vi = &solverVelocity[i * 3];
+        float divergence = 0.0f;
+        for (int e = neighborList.getOffset(i); e < pairEnd[i]; e++) {
+          const float *vj = &solverVelocity[pairJ[e] * 3];
+          divergence += ps.masses[pairJ[e]] *
+                        ((vi[0] - vj[0]) * pairGradX[e] +
+                         (vi[1] - vj[1]) * pairGradY[e] +
+                         (vi[2] - vj[2]) * pairGradZ[e]);
+        }
+        float predicted = std::max(ps.densities[i] + dt * divergence, 0.0f);
+        float wanted = gasConstant * predicted *
+                       std::max(ps.temperatures[i], 0.0f);
+        float residual = wanted - ps.pressures[i];
+        ps.pressures[i] =
+            std::max(ps.pressures[i] + solverScale[i] * residual, 0.0f);
+        residualSum += std::fabs(residual);
+        pressureSum += wanted;
+      }
+      chunkResidual[chunk] = residualSum;
+      chunkPressure[chunk] = pressureSum;
+    });
+    solverStats.iterations++;
+
+    double residualSum = 0.0, pressureSum = 0.0;
+    for (int c = 0; c < threads; c++) {
+      residualSum += chunkResidual[c];
+      pressureSum += chunkPressure[c];
+    }
+    solverStats.residual =
+        pressureSum > 0.0 ? (float)(residualSum / pressureSum) : 0.0f;
+    if (solverStats.iterations >= solverMinIterations &&
+        solverStats.residual <= solverTolerance) {
+      solverStats.converged = true;
+      break;
     }
   }
+
+  // 4. Forces from the final pressures
+  RunPhase(EnginePhase::Pressure, liveEnd, [&](int begin, int end, int) {
+    for (int i = begin; i < end; i++) {
+      if (!ps.isActive(i))
+        continue;
+      vec3 accel;
+      pressureAccel(i, accel);
+      glm_vec3_muladds(accel, ps.masses[i], ps.force(i));
+    }
+  }, PARTICLE_GRAIN);
 }
 
 // D. Integration
+// Symplectic Euler: v += a dt, then x += v dt.
+// Leapfrog (kick-drift-kick): v(n+1/2) = v(n) + a(n) dt/2, x += v(n+1/2) dt,
+// v(n+1) = v(n+1/2) + a(n+1) dt/2. a(n+1) only exists once the next step's
+// force passes ran, so the closing kick is deferred to the next Integrate
+// and taken together with that step's opening one; between steps the
+// velocities are the half-step ones. For the force passes in between,
+// PredictVelocities estimates the closing kick from the old forces (still
+// in ps.forces) and Integrate takes the estimate back out. A particle
+// added mid-run counts its initial velocity as a half-step one.
+void SteamEngine::PredictVelocities() {
+  ResetPhase(EnginePhase::Integrate); // Timed with Integrate
+  angularSpeeds.resize(liveEnd);
+  if (integrator != Integrator::Leapfrog) {
+    pendingHalfDt = 0.0f;
+    return;
+  }
+
+  ParticleStore &ps = particlePool;
+  predictorKick.resize(liveEnd * 3);
+  RunPhase(EnginePhase::Integrate, liveEnd, [&](int begin, int end, int) {
+    for (int i = begin; i < end; i++) {
+      if (!ps.isActive(i))
+        continue;
+      float *velocity = ps.velocity(i);
+      vec3 accel;
+      glm_vec3_scale(ps.force(i), 1.0f / ps.masses[i], accel);
+      glm_vec3_muladds(velocity, -drag, accel);
+      float *kick = &predictorKick[i * 3];
+      glm_vec3_scale(accel, pendingHalfDt, kick);
+      glm_vec3_add(velocity, kick, velocity);
+    }
+  }, PARTICLE_GRAIN);
+}
+
+float SteamEngine::KickTime(float deltaTime) const {
+  if (integrator == Integrator::Leapfrog)
+    return pendingHalfDt + 0.5f * deltaTime; // Closing + opening kick
+  return deltaTime;
+}
+
 void SteamEngine::Integrate(float deltaTime) {
-  for (auto &p : particlePool) {
-    if (!p.active)
-      continue;
+  ParticleStore &ps = particlePool;
+  const bool leapfrog = integrator == Integrator::Leapfrog;
+  const float kickTime = KickTime(deltaTime);
+  const float damping = std::exp(-drag * deltaTime);
+
+  // Squared maxima per worker, reduced after the loop
+  threadMotion.assign(threadPool->getThreadCount(), MotionStats());
+  RunPhase(EnginePhase::Integrate, liveEnd,
+           [&](int begin, int end, int worker) {
+    float maxSpeed2 = 0.0f, maxAccel2 = 0.0f;
+    for (int i = begin; i < end; i++) {
+      if (!ps.isActive(i))
+        continue;
 
-    // F = ma => a = F/m
-    vec3 accel;
-    glm_vec3_scale(p.force, 1.0f / p.mass, accel);
-
-    // v += a * dt
-    vec3 dv;
-    glm_vec3_scale(accel, deltaTime, dv);
-    glm_vec3_add(p.velocity, dv, p.velocity);
-
-    // Damping/Drag
-    glm_vec3_scale(p.velocity, 0.99f, p.velocity);
-
-    // p += v * dt
-    vec3 dx;
-    glm_vec3_scale(p.velocity, deltaTime, dx);
-    glm_vec3_add(p.position, dx, p.position);
-
-    // [NEW] Update Angle for rendering (if we had rotating sprites)
-    // Magnitude of the angular velocity vector is the speed of rotation
-    // (radians/sec)
-    float rotationSpeed = glm_vec3_norm(p.angularVelocity);
-    p.currentAngle += rotationSpeed * deltaTime;
-
-    // Simple Floor Collision
-    // Floor is at y = -15.0f (Height 30)
-    if (p.position[1] < -15.0f) {
-      p.position[1] = -15.0f;
-      p.velocity[1] *= -0.5f;
+      float *position = ps.position(i);
+      float *velocity = ps.velocity(i);
+
+      // F = ma => a = F/m
+      vec3 accel;
+      glm_vec3_scale(ps.force(i), 1.0f / ps.masses[i], accel);
+      maxAccel2 = std::max(maxAccel2, glm_vec3_norm2(accel));
+
+      if (leapfrog) {
+        // Drag as a force at the predicted velocity, then back to the
+        // half-step velocity the kicks start from
+        glm_vec3_muladds(velocity, -drag, accel);
+        glm_vec3_sub(velocity, &predictorKick[i * 3], velocity);
+        glm_vec3_muladds(accel, kickTime, velocity);
+      } else {
+        // v += a * dt, then Damping/Drag
+        glm_vec3_muladds(accel, kickTime, velocity);
+        glm_vec3_scale(velocity, damping, velocity);
+      }
+
+      // p += v * dt
+      glm_vec3_muladds(velocity, deltaTime, position);
+
+      // Render angle (if we had rotating sprites): |omega| is the speed
+      // of rotation in radians/sec
+      ps.angles[i] += angularSpeeds[i] * deltaTime;
+
+      // Simple Floor Collision
+      // Floor is at y = -15.0f (Height 30)
+      if (position[1] < -15.0f) {
+        position[1] = -15.0f;
+        velocity[1] *= -0.5f;
+      }
+      maxSpeed2 = std::max(maxSpeed2, glm_vec3_norm2(velocity));
     }
+    MotionStats &motion = threadMotion[worker];
+    motion.maxSpeed = std::max(motion.maxSpeed, maxSpeed2);
+    motion.maxAcceleration = std::max(motion.maxAcceleration, maxAccel2);
+  }, PARTICLE_GRAIN);
+  pendingHalfDt = leapfrog ? 0.5f * deltaTime : 0.0f;
+
+  motionStats = MotionStats();
+  for (const MotionStats &motion : threadMotion) {
+    motionStats.maxSpeed = std::max(motionStats.maxSpeed, motion.maxSpeed);
+    motionStats.maxAcceleration =
+        std::max(motionStats.maxAcceleration, motion.maxAcceleration);
   }
+  motionStats.maxSpeed = std::sqrt(motionStats.maxSpeed);
+  motionStats.maxAcceleration = std::sqrt(motionStats.maxAcceleration);
 }
 
 // E. Thermodynamics & Death
 void SteamEngine::UpdateThermodynamics(float deltaTime) {
-  for (size_t i = 0; i < particlePool.size(); ++i) {
-    SteamParticle &p = particlePool[i];
-    if (!p.active)
-      continue;
+  ResetPhase(EnginePhase::Thermodynamics);
+  ParticleStore &ps = particlePool;
+
+  // Dead particles just go inactive; CompactParticles reclaims their slots
+  threadDeaths.assign(threadPool->getThreadCount(), 0);
+  RunPhase(EnginePhase::Thermodynamics, liveEnd,
+           [&](int begin, int end, int worker) {
+    int deaths = 0;
+    for (int i = begin; i < end; ++i) {
+      if (!ps.isActive(i))
+        continue;
 
-    // Cooling
-    p.temperature -= coolingRate * deltaTime;
-    if (p.temperature < 0.0f)
-      p.temperature = 0.0f;
-
-    // Aging
-    p.life -= deltaTime;
-    if (p.life <= 0.0f || p.temperature <= 0.05f) {
-      p.active = false;
-      // Return to free list
-      deadParticleIndices.push_back((int)i);
+      // Cooling
+      float &temperature = ps.temperatures[i];
+      temperature -= coolingRate * deltaTime;
+      if (temperature < 0.0f)
+        temperature = 0.0f;
+
+      // Aging
+      ps.lives[i] -= deltaTime;
+      if (ps.lives[i] <= 0.0f || temperature <= 0.05f) {
+        ps.active[i] = 0;
+        deaths++;
+      }
     }
+    threadDeaths[worker] += deaths;
+  }, PARTICLE_GRAIN);
+
+  for (int deaths : threadDeaths)
+    activeCount -= deaths;
+}
+
+void SteamEngine::CompactParticles() {
+  if (activeCount == liveEnd)
+    return; // No holes
+
+  // Stable, so the Morton order of a reorder survives and the oldest
+  // particles stay in front
+  int out = 0;
+  while (particlePool.isActive(out))
+    out++;
+  for (int i = out + 1; i < liveEnd; i++) {
+    if (particlePool.isActive(i))
+      particlePool.CopySlot(out++, i);
   }
+  std::fill(particlePool.active.begin() + out,
+            particlePool.active.begin() + liveEnd, 0);
+  liveEnd = out;
+}
+
+void SteamEngine::ResetPhase(EnginePhase phase) {
+  phaseStats[(int)phase] = PhaseStats();
+}
+
+void SteamEngine::RunPhase(EnginePhase phase, int count,
+                           const std::function<void(int, int, int)> &fn,
+                           int grain) {
+  int threads = threadPool->getThreadCount();
+  phaseBusy.assign(threads, 0.0f);
+
+  auto start = std::chrono::high_resolution_clock::now();
+  std::function<void(int, int, int)> timed = [&](int begin, int end,
+                                                 int worker) {
+    auto chunkStart = std::chrono::high_resolution_clock::now();
+    fn(begin, end, worker);
+    auto chunkEnd = std::chrono::high_resolution_clock::now();
+    phaseBusy[worker] +=
+        std::chrono::duration<float, std::milli>(chunkEnd - chunkStart)
+            .count();
+  };
+  if (grain > 0)
+    threadPool->ParallelForDynamic(count, grain, timed);
+  else
+    threadPool->ParallelFor(count, timed);
+  auto end = std::chrono::high_resolution_clock::now();
+
+  PhaseStats &stats = phaseStats[(int)phase];
+  stats.wallMs += std::chrono::duration<float, std::milli>(end - start).count();
+  for (float busy : phaseBusy)
+    stats.busyMs += busy;
+  stats.efficiency =
+      stats.wallMs > 0.0f ? stats.busyMs / (stats.wallMs * threads) : 0.0f;
 }
 
 // F. Spawning
 void SteamEngine::SpawnParticles(float deltaTime) {
-  static float timeAccumulator = 0.0f;
-  timeAccumulator += deltaTime;
+  spawnAccumulator += deltaTime;
 
   float interval = 1.0f / emissionRate;
 
-  while (timeAccumulator > interval) {
-    timeAccumulator -= interval;
+  while (spawnAccumulator > interval) {
+    spawnAccumulator -= interval;
 
-    if (!deadParticleIndices.empty()) {
-      int idx = deadParticleIndices.back();
-      deadParticleIndices.pop_back();
-
-      SteamParticle &p = particlePool[idx];
-      p = SteamParticle(); // Reset
+    if (liveEnd < (int)particlePool.size()) {
+      SteamParticle p; // Reset
       p.active = true;
       p.life = 10.0f;
       p.temperature = 1.0f;
@@ -300,6 +1260,22 @@ void SteamEngine::SpawnParticles(float deltaTime) {
       // Zero out initial spin, it will be calculated by Vorticity
       glm_vec3_zero(p.angularVelocity);
       p.currentAngle = 0.0f;
+
+      AddParticle(p);
     }
   }
 }
+
+int SteamEngine::AddParticle(const SteamParticle &particle) {
+  if (liveEnd >= (int)particlePool.size())
+    return -1;
+
+  int idx = liveEnd++;
+  activeCount++;
+  particlePool.set(idx, particle);
+  particlePool.active[idx] = 1;
+  glm_vec3_zero(particlePool.force(idx)); // Read by PredictVelocities
+  particlePool.ids[idx] = nextParticleId++;
+  verletValid = false; // Not in the lists yet
+  return idx;
+}
@@ -1,10 +1,94 @@
 #ifndef STEAMENGINE_H
 #define STEAMENGINE_H
 
-#include "../particle/SteamParticle.h"
+#include "../particle/ParticleStore.h"
+#include "NeighborList.h"
 #include "SpatialGrid.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
 #include <vector>
 
+// How the SPH passes find their neighbors
+enum class NeighborMode {
+  Recompute, // Walk the grid cells in every pass
+  Cached,    // Build CSR neighbor lists once per step, reuse in every pass
+  Verlet     // Lists with a skin radius, rebuilt only when particles moved
+};
+
+// Counters for the Verlet list mode
+struct NeighborStats {
+  long verletSteps = 0;          // Steps run in Verlet mode
+  long rebuilds = 0;             // Steps that rebuilt grid and lists
+  long displacementRebuilds = 0; // ... because a particle moved > skin / 2
+  long ageRebuilds = 0;          // ... because verletMaxSteps was reached
+  float maxDisplacement = 0.0f;  // Largest move since the last rebuild
+  int stepsSinceRebuild = 0;
+};
+
+// Counters for the periodic Morton reorder of the pool
+struct ReorderStats {
+  long reorders = 0;
+  int stepsSinceReorder = 0;
+  float lastReorderMs = 0.0f; // Cost of the most recent reorder
+};
+
+// Result of the startup grid autotune
+struct GridTuning {
+  bool pending = false;
+  bool done = false;
+  float msPerConfig[2] = {0.0f, 0.0f}; // Build + sweep, cells of h and h/2
+  int chosenCellsPerRadius = 1;
+};
+
+// How pressure is obtained each step
+enum class PressureSolver {
+  EquationOfState, // p = gasConstant * density * temperature, explicit
+  Iterative        // Same equation, implicit: pressures are iterated until
+                   // they match the density they lead to by step end
+};
+
+// How Integrate advances velocities and positions
+enum class Integrator {
+  SymplecticEuler, // v += a dt, then x += v dt; first order
+  Leapfrog         // Kick-drift-kick, second order (see Integrate)
+};
+
+// Convergence of the iterative pressure solver in the most recent step
+struct PressureSolverStats {
+  int iterations = 0;
+  float residual = 0.0f; // |k * rho* * T - p| relative to the pressures
+  bool converged = false;
+};
+
+// Fastest particle of the most recent step, for picking the next time step
+struct MotionStats {
+  float maxSpeed = 0.0f;        // |v| after integration
+  float maxAcceleration = 0.0f; // |F| / m that produced it
+};
+
+// Stages of SteamEngine::Update that run on the thread pool
+enum class EnginePhase {
+  Density,
+  Vorticity,
+  Forces,
+  Pressure, // Iterative solver only
+  Integrate,
+  Thermodynamics,
+  Count
+};
+
+// Timing of one phase in the most recent step
+struct PhaseStats {
+  float wallMs = 0.0f;
+  float busyMs = 0.0f;     // Summed over threads, inside the loop bodies
+  float efficiency = 0.0f; // busyMs / (wallMs * threads); the rest is idle
+                           // time from imbalance plus dispatch overhead
+};
+
 class SteamEngine {
 public:
   SteamEngine(float& spawn_range_mult);
@@ -13,11 +97,71 @@ public:
   // Initialization
   void Initialize(int maxParticles);
 
+  // Bounded scenes: lets the neighbor grid use collision-free dense cells
+  void SetDomainBounds(const vec3 minBounds, const vec3 maxBounds);
+
+  // Run the parallel stages on a pool shared with the rest of the
+  // application (not owned; nullptr = a private pool). The engine must not
+  // be updated while the pool changes its thread count.
+  void SetThreadPool(ThreadPool *pool);
+  // Threads of the pool in use (0 = one per hardware thread); with a shared
+  // pool this resizes it for every user
+  void SetThreadCount(int numThreads);
+  int getThreadCount() const;
+  // Width of the emitter (writes the multiplier passed to the constructor)
+  void SetSpawnRange(float multiplier) { spawn_range_multiplier = multiplier; }
+  float getSpawnRange() const { return spawn_range_multiplier; }
+  const PhaseStats &getPhaseStats(EnginePhase phase) const;
+  static const char *getPhaseName(EnginePhase phase);
+
   // Main update loop
   void Update(float deltaTime);
 
+  // Place a particle directly, next to the emitter's own (scripted scenes,
+  // the headless runner). Gets a fresh id and is marked active; returns
+  // its slot, or -1 when the pool is full. Call between steps.
+  int AddParticle(const SteamParticle &particle);
+
   // Rendering Interface
-  const std::vector<SteamParticle> &getParticles() const;
+  const ParticleStore &getParticles() const;
+  // Live particles are packed into slots [0, getUsedSlots()); slots that
+  // died since the last compaction are inactive holes inside that range
+  int getActiveCount() const { return activeCount; }
+  int getUsedSlots() const { return liveEnd; }
+
+  // Stats: memory held by the cached neighbor lists (0 in Recompute mode
+  // unless the fused passes or the iterative solver need them)
+  size_t getNeighborListBytes() const;
+  size_t getNeighborListEntries() const;
+  const NeighborStats &getNeighborStats() const;
+  const ReorderStats &getReorderStats() const;
+  const GridTuning &getGridTuning() const;
+  const MotionStats &getMotionStats() const;
+  const PressureSolverStats &getPressureSolverStats() const;
+
+  // Occupancy / collision report for the neighbor grid (walks the whole
+  // table, meant for the debug UI)
+  GridDiagnostics getGridDiagnostics(int sampleStride = 64) const;
+  const GridUpdateStats &getGridUpdateStats() const;
+
+  // Spatial queries for probes and picking, at any radius. The grid is as
+  // of the last neighbor build; in Verlet mode the walk is widened by the
+  // skin so particles that drifted since are still found (particles spawned
+  // since are not in it yet).
+  template <typename Visitor>
+  void ForEachInRadius(const vec3 center, float radius, Visitor &&visit) const {
+    neighborGrid.ForEachInRadius(center, radius, particlePool, visit,
+                                 QuerySlack());
+  }
+  // k nearest live particles, nearest first; returns how many were written
+  int FindNearest(const vec3 center, int k, int *outIndices,
+                  float *outDist2) const;
+  // SPH density estimate (Poly6 over h) at an arbitrary point
+  float SampleDensity(const vec3 position) const;
+
+  // Time both grid resolutions on the live particles once enough of them
+  // exist (autotuneMinParticles) and keep the faster one
+  void RequestGridAutotune();
 
 private:
   // std::vector<SteamParticle> particles; // Replacing with particlePool
@@ -25,12 +169,156 @@ private:
   // Simulation Steps
   // Simulation Steps
   void SpawnParticles(float deltaTime);       // A. Emission
-  void CalculateDensityAndPressure();         // B. Density & Pressure
-  void CalculateVorticity();                  // [NEW] Vorticity Calculation
-  void CalculateForces();                     // C. Force Accumulation
-  void Integrate(float deltaTime);            // D. Integration
+  // The SPH passes are templates on the kernel (a Kernel::Fixed for the
+  // standard radii, Kernel::Runtime otherwise), picked once per step
+  struct KernelStep;
+  template <typename K> void CalculateSph(float deltaTime);
+  template <typename K> void CalculateDensityAndPressure(); // B. Density
+  template <typename K> void CalculateVorticity(); // [NEW] Vorticity
+  template <typename K> void CalculateVorticityPairs(); // Half-shell variants
+  template <typename K> void CalculateForces();    // C. Force Accumulation
+  template <typename K> void CalculateForcesPairs();
+  // Fused: density + geometry (+ equation of state pressure)
+  template <typename K> void CalculateDensityFused(bool statePressure = true);
+  // Fused: vorticity + forces (+ pressure forces)
+  void CalculateForcesFused(bool pressureForces = true);
+  // Iterative pressure: adds the pressure forces to the other forces
+  void SolvePressure(float deltaTime);
+  void ApplyBodyForces(size_t i);
+  void ApplyVorticityConfinement(size_t i);
+  void PredictVelocities();                   // D. Integration
+  void Integrate(float deltaTime);
+  float KickTime(float deltaTime) const; // Velocity change per unit accel
   void UpdateThermodynamics(float deltaTime); // E. Thermodynamics & Death
 
+  // Sort live particles by Z-order cell key and pack them at the front
+  void ReorderParticles();
+  // Close the holes left by dead particles, keeping slot order
+  void CompactParticles();
+
+  // Radius the grid and lists must cover: h, plus the skin in Verlet mode
+  float SearchRadius() const;
+  // How far particles may have moved since the grid was built
+  float QuerySlack() const;
+  void AutotuneGrid();
+
+  // Verlet mode: true when the lists no longer cover every pair within h
+  bool NeedsVerletRebuild();
+  // Lists are built in Cached / Verlet mode, and for the fused passes and
+  // the iterative solver
+  bool UsesNeighborList() const;
+  void BuildNeighbors();
+  // Verlet mode between rebuilds: add the particles spawned this step,
+  // slots [first, liveEnd), to the lists
+  void InsertSpawned(int first);
+
+  // Visit the neighbor candidates of particle i from whichever source the
+  // current NeighborMode uses. Callers still apply their own radius test.
+  template <typename Visitor> void ForEachNeighbor(size_t i, Visitor &&visit) {
+    if (neighborMode != NeighborMode::Recompute)
+      neighborList.ForEach(i, visit);
+    else
+      neighborGrid.ForEachNeighbor(particlePool.position(i), visit);
+  }
+
+  // Visit every candidate pair once: visit(int i, int j). Uses the grid's
+  // half-shell walk in Recompute mode and the j > i half of the lists
+  // otherwise (the lists are symmetric). Part 'part' of 'parts' visits a
+  // disjoint share of the pairs, so threads can split the walk.
+  template <typename PairVisitor>
+  void ForEachPair(int part, int parts, PairVisitor &&visit) {
+    if (neighborMode == NeighborMode::Recompute) {
+      neighborGrid.ForEachPairInRange(
+          particlePool, neighborGrid.PairUnitBoundary(part, parts),
+          neighborGrid.PairUnitBoundary(part + 1, parts), visit);
+      return;
+    }
+    long span = liveEnd;
+    int begin = (int)(span * part / parts);
+    int end = (int)(span * (part + 1) / parts);
+    for (int i = begin; i < end; i++) {
+      neighborList.ForEach(i, [&](int j) {
+        if (j > i)
+          visit(i, j);
+      });
+    }
+  }
+
+  // Run fn(begin, end, worker) over [0, count) on the pool and add its wall
+  // and busy time to the phase. ResetPhase starts a phase's timing.
+  // grain 0 uses the pool's static chunks (worker = chunk index, for loops
+  // that merge per-chunk results in order); grain > 0 hands out stealable
+  // ranges of about that many items (worker = executing slot), which evens
+  // out loops whose per-particle cost varies with neighbor counts.
+  void RunPhase(EnginePhase phase, int count,
+                const std::function<void(int, int, int)> &fn, int grain = 0);
+  void ResetPhase(EnginePhase phase);
+
+  // pairBounds for ForEachPair split into 'parts'. The split only changes
+  // with the grid or the lists, so this runs once per neighbor build (from
+  // the per-block maxima of the lists, or a walk over the grid's pairs in
+  // Recompute mode).
+  void UpdatePairBounds(EnginePhase phase, int parts);
+
+  // Symmetric passes: term(i, j, accI, accJ) adds the pair's contributions
+  // to the xyz accumulators of both particles, which end up added to
+  // 'target'. With several threads each part sums into its own slice of
+  // pairScratch covering just the slot range [lo, hi) its pairs touch (a
+  // narrow window when slots follow space, as after a reorder, instead of
+  // every live particle). The slices are reduced in part order, so results
+  // only depend on the thread count.
+  template <typename PairTerm>
+  void AccumulatePairs(EnginePhase phase, ParticleStore::FloatArray &target,
+                       PairTerm &&term) {
+    const int threads = threadPool->getThreadCount();
+    if (threads == 1) {
+      RunPhase(phase, 1, [&](int, int, int) {
+        ForEachPair(0, 1, [&](int i, int j) {
+          term(i, j, &target[i * 3], &target[j * 3]);
+        });
+      });
+      return;
+    }
+
+    if (pairBoundsParts != threads)
+      UpdatePairBounds(phase, threads);
+
+    pairScratchStart.resize(threads + 1);
+    pairScratchStart[0] = 0;
+    for (int p = 0; p < threads; p++)
+      pairScratchStart[p + 1] =
+          pairScratchStart[p] +
+          (size_t)(pairBounds[p * 2 + 1] - pairBounds[p * 2]) * 3;
+    pairScratch.resize(pairScratchStart[threads]);
+
+    RunPhase(phase, threads, [&](int part, int, int) {
+      const int lo = pairBounds[part * 2];
+      float *acc = pairScratch.data() + pairScratchStart[part];
+      std::fill(acc, pairScratch.data() + pairScratchStart[part + 1], 0.0f);
+      ForEachPair(part, threads, [&](int i, int j) {
+        term(i, j, acc + (i - lo) * 3, acc + (j - lo) * 3);
+      });
+    });
+    RunPhase(phase, liveEnd, [&](int begin, int end, int) {
+      for (int i = begin; i < end; i++) {
+        float sum[3] = {0.0f, 0.0f, 0.0f};
+        for (int p = 0; p < threads; p++) {
+          const int lo = pairBounds[p * 2], hi = pairBounds[p * 2 + 1];
+          if (i < lo || i >= hi)
+            continue;
+          const float *acc =
+              pairScratch.data() + pairScratchStart[p] + (i - lo) * 3;
+          sum[0] += acc[0];
+          sum[1] += acc[1];
+          sum[2] += acc[2];
+        }
+        target[i * 3 + 0] += sum[0];
+        target[i * 3 + 1] += sum[1];
+        target[i * 3 + 2] += sum[2];
+      }
+    });
+  }
+
   // SETTINGS (Public for UI)
 public:
   float gravity;
@@ -39,12 +327,89 @@ public:
   float gasConstant;           // How hard it expands
   float ambientTemperature;    // Temperature where lift stops
   float emissionRate = 200.0f; // Added default
+  NeighborMode neighborMode = NeighborMode::Recompute;
+  bool symmetricPairs = false; // Evaluate each pair once (half shell)
+  bool fusedPasses = false;    // Density and the pair geometry in one
+                               // sweep, vorticity and forces in a second
+                               // (overrides symmetricPairs; Recompute mode
+                               // builds lists for it every step)
+  int reorderInterval = 0;     // Morton reorder every N steps (0 = off)
+  int gridCellsPerRadius = 1;  // 1: cells of h, 27-cell stencil
+                               // 2: cells of h/2, 125-cell stencil
+  int autotuneMinParticles = 1000;
+  bool incrementalGrid = false; // Only move particles that changed cell
+  float verletSkin = 0.3f;  // Extra list radius beyond the kernel h
+  int verletMaxSteps = 20;  // Rebuild at least this often
+  // Iterative solver, runs on the fused passes' cached pairs. Recompute mode
+  // builds lists for it every step (as Cached would) while it is selected.
+  PressureSolver pressureSolver = PressureSolver::EquationOfState;
+  float solverTolerance = 0.01f;  // Relative residual to stop at
+  int solverMinIterations = 2;
+  int solverMaxIterations = 20;
+  bool solverWarmStart = true;    // Start from last step's pressures
+  Integrator integrator = Integrator::SymplecticEuler;
+  float drag = 0.603f; // Velocity lost per second, v *= exp(-drag * dt)
+                       // (0.603 = 0.99 per step at 60 Hz)
 
 private:
   // MEMORY
-  std::vector<SteamParticle> particlePool;
-  std::vector<int> deadParticleIndices; // Free list for O(1) spawning
+  ParticleStore particlePool;
   SpatialGrid neighborGrid;             // Helper for fast lookups
+  NeighborList neighborList;            // Cached / Verlet, iterative solver
+  ThreadPool *threadPool;                // Shared or ownedPool
+  std::unique_ptr<ThreadPool> ownedPool; // When no pool was handed in
+  std::vector<float> verletReference;   // Positions at last build (xyz)
+  float verletRadius = 0.0f;            // List radius at last build
+  int verletGridEnd = 0;                // liveEnd when the grid was built
+  std::vector<std::pair<int, int>> insertPairs; // Scratch for InsertSpawned
+  bool verletValid = false;
+  NeighborStats neighborStats;
+  float spawnAccumulator = 0.0f;
+  unsigned int nextParticleId = 0;
+  ReorderStats reorderStats;
+
+  // Live set. Spawning appends at liveEnd and deaths only clear the active
+  // flag; CompactParticles packs the survivors back to the front before
+  // each neighbor build. Every particle loop covers [0, liveEnd) only.
+  int liveEnd = 0;
+  int activeCount = 0;
+
+  // Threading
+  PhaseStats phaseStats[(int)EnginePhase::Count];
+  std::vector<float> phaseBusy;                // Per worker, current phase
+  std::vector<int> threadDeaths;               // Per worker, Thermodynamics
+  std::vector<MotionStats> threadMotion;       // Per worker, Integrate
+  MotionStats motionStats;
+
+  // Pressure solver scratch, per slot
+  ParticleStore::FloatArray solverVelocity; // Predicted, xyz
+  ParticleStore::FloatArray solverScale;    // Pressure per unit of error
+  std::vector<double> chunkResidual;        // Per static chunk
+  std::vector<double> chunkPressure;
+  PressureSolverStats solverStats;
+
+  // AccumulatePairs scratch, per part
+  ParticleStore::FloatArray pairScratch; // Slices, xyz per slot in range
+  std::vector<int> pairBounds;           // Slot range [lo, hi) per part
+  int pairBoundsParts = 0;               // Parts they are for, 0 = stale
+  std::vector<size_t> pairScratchStart;  // Slice offsets, parts + 1
+
+  // Integration scratch, per slot
+  ParticleStore::FloatArray predictorKick; // Leapfrog: added to v, xyz
+  ParticleStore::FloatArray angularSpeeds; // |omega|, confinement pass
+  float pendingHalfDt = 0.0f; // Leapfrog: closing half kick still owed
+
+  // Fused passes: per neighbor-list entry, the pairs inside the kernel
+  // (0 < r < h) packed at the front of each particle's range with their
+  // GradW(x_i - x_j); particle i's pairs are [offset(i), pairEnd[i])
+  std::vector<int> pairEnd;
+  std::vector<int> pairJ;
+  ParticleStore::FloatArray pairGradX, pairGradY, pairGradZ;
+  ParticleStore::FloatArray pairR;
+  GridTuning gridTuning;
+  std::vector<std::pair<unsigned long long, int>> reorderKeys; // Scratch
+  std::vector<int> reorderOrder;
+  ParticleStore reorderScratch;
   float& spawn_range_multiplier;
 };
 
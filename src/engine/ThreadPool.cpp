@@ -0,0 +1,323 @@
+#include "ThreadPool.h"
+#include <chrono>
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+long long ElapsedNs(Clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                              start)
+      .count();
+}
+
+// The pool and slot the current thread is working for. Workers set it once;
+// outside threads set it for the length of a call, so calls made from inside
+// a task are recognized as nested.
+struct ThreadContext {
+  const void *pool;
+  int slot;
+  int depth; // Tasks being executed on this thread, nested included
+};
+thread_local ThreadContext context = {nullptr, 0, 0};
+
+// How long a waiting caller sleeps before looking for stealable work again
+const std::chrono::microseconds WAIT_POLL(100);
+} // namespace
+
+ThreadPool::ThreadPool(int numThreads)
+    : threadCount(1), queued(0), stopping(false), activeCalls(0),
+      reconfiguring(false) {
+  SetThreadCount(numThreads);
+}
+
+ThreadPool::~ThreadPool() { StopWorkers(); }
+
+void ThreadPool::SetThreadCount(int numThreads) {
+  if (numThreads <= 0)
+    numThreads = (int)std::thread::hardware_concurrency();
+  if (numThreads <= 0)
+    numThreads = 1;
+
+  std::unique_lock<std::mutex> config(configMutex);
+  if (numThreads == threadCount && (int)slots.size() == threadCount)
+    return;
+
+  reconfiguring = true;
+  configCv.wait(config, [this] { return activeCalls == 0; });
+  StopWorkers();
+  threadCount = numThreads;
+  StartWorkers();
+  reconfiguring = false;
+  configCv.notify_all();
+}
+
+int ThreadPool::getThreadCount() const { return threadCount; }
+
+void ThreadPool::StartWorkers() {
+  stopping = false;
+  slots.clear();
+  for (int s = 0; s < threadCount; ++s) {
+    slots.push_back(std::unique_ptr<Slot>(new Slot()));
+    SlotCounters &c = slots.back()->counters;
+    c.busyNs = 0;
+    c.idleNs = 0;
+    c.tasks = 0;
+    c.steals = 0;
+  }
+  for (int w = 1; w < threadCount; ++w)
+    workers.push_back(std::thread(&ThreadPool::WorkerLoop, this, w));
+}
+
+void ThreadPool::StopWorkers() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  sleepCv.notify_all();
+  for (auto &t : workers)
+    t.join();
+  workers.clear();
+}
+
+// A. Calls
+
+int ThreadPool::CurrentSlot() const {
+  return context.pool == this ? context.slot : -1;
+}
+
+bool ThreadPool::EnterCall() {
+  if (CurrentSlot() >= 0)
+    return false; // Nested: the outer call already holds the pool
+
+  std::unique_lock<std::mutex> config(configMutex);
+  configCv.wait(config, [this] { return !reconfiguring; });
+  activeCalls++;
+  return true;
+}
+
+void ThreadPool::LeaveCall(bool entered) {
+  if (!entered)
+    return;
+  std::lock_guard<std::mutex> config(configMutex);
+  if (--activeCalls == 0)
+    configCv.notify_all();
+}
+
+void ThreadPool::ParallelFor(int count,
+                             const std::function<void(int, int, int)> &fn) {
+  if (count <= 0)
+    return;
+  bool entered = EnterCall();
+  if (threadCount == 1) {
+    LeaveCall(entered);
+    fn(0, count, 0);
+    return;
+  }
+
+  ThreadContext saved = context;
+  int slot = entered ? 0 : context.slot;
+  context.pool = this;
+  context.slot = slot;
+
+  Group group;
+  group.pending = threadCount;
+  for (int w = threadCount - 1; w >= 1; --w) {
+    Task task;
+    task.fn = &fn;
+    task.begin = (int)((long)count * w / threadCount);
+    task.end = (int)((long)count * (w + 1) / threadCount);
+    task.grain = 0;
+    task.chunk = w;
+    task.group = &group;
+    Push(slot, task);
+  }
+
+  Task first = {&fn, 0, (int)((long)count / threadCount), 0, 0, &group};
+  Execute(first, slot);
+  Wait(group, slot);
+
+  context = saved;
+  LeaveCall(entered);
+}
+
+void ThreadPool::ParallelForDynamic(
+    int count, int grain, const std::function<void(int, int, int)> &fn) {
+  if (count <= 0)
+    return;
+  if (grain < 1)
+    grain = 1;
+  bool entered = EnterCall();
+  int slot = entered ? 0 : context.slot;
+  if (threadCount == 1 || count <= grain) {
+    LeaveCall(entered);
+    fn(0, count, slot);
+    return;
+  }
+
+  ThreadContext saved = context;
+  context.pool = this;
+  context.slot = slot;
+
+  Group group;
+  group.pending = 1;
+  Task all = {&fn, 0, count, grain, -1, &group};
+  Execute(all, slot);
+  Wait(group, slot);
+
+  context = saved;
+  LeaveCall(entered);
+}
+
+// B. Scheduling
+
+void ThreadPool::Push(int slot, const Task &task) {
+  {
+    std::lock_guard<std::mutex> lock(slots[slot]->mutex);
+    slots[slot]->tasks.push_back(task);
+    queued++;
+  }
+  {
+    // Pairs with the predicate check in WorkerLoop, so the wakeup is not lost
+    std::lock_guard<std::mutex> lock(sleepMutex);
+  }
+  sleepCv.notify_one();
+}
+
+// Own deque from the back (newest, still warm in cache), other deques from
+// the front (oldest, the biggest ranges left). With 'only' set, just that
+// group's tasks qualify: a thread waiting on a call must not pick up
+// unrelated work that could keep it from returning.
+bool ThreadPool::TakeTask(int slot, const Group *only, Task &task) {
+  for (int k = 0; k < threadCount; ++k) {
+    int victim = (slot + k) % threadCount;
+    Slot &s = *slots[victim];
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.tasks.empty())
+      continue;
+
+    if (!only) {
+      if (k == 0) {
+        task = s.tasks.back();
+        s.tasks.pop_back();
+      } else {
+        task = s.tasks.front();
+        s.tasks.pop_front();
+      }
+    } else {
+      std::deque<Task>::iterator it = s.tasks.end();
+      if (k == 0) {
+        for (std::deque<Task>::iterator i = s.tasks.end();
+             i != s.tasks.begin();) {
+          if ((--i)->group == only) {
+            it = i;
+            break;
+          }
+        }
+      } else {
+        for (std::deque<Task>::iterator i = s.tasks.begin();
+             i != s.tasks.end(); ++i) {
+          if (i->group == only) {
+            it = i;
+            break;
+          }
+        }
+      }
+      if (it == s.tasks.end())
+        continue;
+      task = *it;
+      s.tasks.erase(it);
+    }
+
+    queued--;
+    if (k != 0)
+      slots[slot]->counters.steals++;
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::Execute(Task task, int slot) {
+  // Split off upper halves for thieves until the rest is one grain
+  if (task.chunk < 0) {
+    while (task.end - task.begin > task.grain) {
+      int mid = task.begin + (task.end - task.begin) / 2;
+      Task right = task;
+      right.begin = mid;
+      task.group->pending++;
+      Push(slot, right);
+      task.end = mid;
+    }
+  }
+
+  Clock::time_point start = Clock::now();
+  context.depth++;
+  (*task.fn)(task.begin, task.end, task.chunk >= 0 ? task.chunk : slot);
+  context.depth--;
+  SlotCounters &c = slots[slot]->counters;
+  if (context.depth == 0)
+    c.busyNs += ElapsedNs(start); // Nested tasks are inside this span
+  c.tasks++;
+
+  if (--task.group->pending == 0) {
+    std::lock_guard<std::mutex> lock(doneMutex);
+    doneCv.notify_all();
+  }
+}
+
+void ThreadPool::Wait(Group &group, int slot) {
+  SlotCounters &c = slots[slot]->counters;
+  while (group.pending > 0) {
+    Task task;
+    if (TakeTask(slot, &group, task)) {
+      Execute(task, slot);
+      continue;
+    }
+
+    // The rest is running elsewhere; wake up when it ends or every poll
+    // interval, in case one of those tasks splits off more work
+    Clock::time_point start = Clock::now();
+    {
+      std::unique_lock<std::mutex> lock(doneMutex);
+      doneCv.wait_for(lock, WAIT_POLL, [&] { return group.pending == 0; });
+    }
+    long long idle = ElapsedNs(start);
+    c.idleNs += idle;
+    if (context.depth > 0)
+      c.busyNs -= idle; // Counted by the enclosing task otherwise
+  }
+}
+
+void ThreadPool::WorkerLoop(int slot) {
+  context.pool = this;
+  context.slot = slot;
+  SlotCounters &c = slots[slot]->counters;
+
+  for (;;) {
+    Task task;
+    if (TakeTask(slot, nullptr, task)) {
+      Execute(task, slot);
+      continue;
+    }
+
+    Clock::time_point start = Clock::now();
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    sleepCv.wait(lock, [this] { return stopping || queued > 0; });
+    c.idleNs += ElapsedNs(start);
+    if (stopping && queued == 0)
+      return;
+  }
+}
+
+// C. Trace
+
+void ThreadPool::TakeStats(std::vector<WorkerTrace> &out) {
+  std::lock_guard<std::mutex> config(configMutex);
+  out.resize(slots.size());
+  for (size_t s = 0; s < slots.size(); ++s) {
+    SlotCounters &c = slots[s]->counters;
+    out[s].busyMs = (float)(c.busyNs.exchange(0) * 1e-6);
+    out[s].idleMs = (float)(c.idleNs.exchange(0) * 1e-6);
+    out[s].tasks = c.tasks.exchange(0);
+    out[s].steals = c.steals.exchange(0);
+  }
+}
@@ -0,0 +1,112 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Per-worker counters since the last ThreadPool::TakeStats() call.
+// Slot 0 is shared by every thread that calls into the pool from outside.
+struct WorkerTrace {
+  float busyMs = 0.0f; // Running tasks
+  float idleMs = 0.0f; // Waiting for work (workers) or for helpers (callers)
+  long tasks = 0;
+  long steals = 0; // Tasks taken from another slot's deque
+};
+
+// Persistent work-stealing scheduler shared by the simulation, the volume
+// build and render prep.
+// Each worker owns a deque of range tasks: it pops its own newest task and
+// steals the oldest (largest) task of another slot when it runs dry. A
+// range task keeps splitting off its upper half until it is down to the
+// grain, so idle threads always find big pieces to take.
+// Calls may come from several threads at once and from inside tasks
+// (nested parallelism); a caller waiting for its tasks helps run them.
+class ThreadPool {
+public:
+  // numThreads counts the calling thread; 0 = one per hardware thread
+  explicit ThreadPool(int numThreads = 0);
+  ~ThreadPool();
+
+  // Must not be called from inside a task; waits for running calls to end
+  void SetThreadCount(int numThreads);
+  int getThreadCount() const;
+
+  // Static split: chunk w of threadCount covers [count * w / T,
+  // count * (w + 1) / T) and fn(begin, end, w) gets the chunk index, so
+  // chunk boundaries and indices only depend on count and the thread count.
+  // Callers can rely on that for deterministic merges.
+  void ParallelFor(int count, const std::function<void(int, int, int)> &fn);
+
+  // Dynamic split for uneven work: [0, count) runs as stealable ranges of
+  // about 'grain' items. fn(begin, end, slot) gets the slot of the thread
+  // running it, in [0, getThreadCount()); no two ranges of one call run on
+  // the same slot at the same time, so per-slot scratch is safe.
+  void ParallelForDynamic(int count, int grain,
+                          const std::function<void(int, int, int)> &fn);
+
+  // Busy / idle time per slot since the previous call
+  void TakeStats(std::vector<WorkerTrace> &out);
+
+private:
+  struct Group {
+    std::atomic<int> pending;
+  };
+  struct Task {
+    const std::function<void(int, int, int)> *fn;
+    int begin, end;
+    int grain; // Dynamic: split down to this size
+    int chunk; // Static: chunk index handed to fn, -1 for dynamic tasks
+    Group *group;
+  };
+  // Written by the slot's own thread(s), read by TakeStats
+  struct SlotCounters {
+    std::atomic<long long> busyNs;
+    std::atomic<long long> idleNs;
+    std::atomic<long> tasks;
+    std::atomic<long> steals;
+  };
+  // Allocated one by one, so slots don't share cache lines
+  struct Slot {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    SlotCounters counters;
+  };
+
+  int threadCount;
+  std::vector<std::thread> workers;
+  std::vector<std::unique_ptr<Slot>> slots;
+
+  std::atomic<int> queued; // Tasks sitting in deques
+  std::mutex sleepMutex;
+  std::condition_variable sleepCv; // Workers wait for queued > 0
+  std::mutex doneMutex;
+  std::condition_variable doneCv; // A group finished
+  bool stopping;
+
+  // SetThreadCount waits for top-level calls to drain
+  std::mutex configMutex;
+  std::condition_variable configCv;
+  int activeCalls;
+  bool reconfiguring;
+
+  void StartWorkers();
+  void StopWorkers();
+  void WorkerLoop(int slot);
+
+  int CurrentSlot() const;
+  bool EnterCall();
+  void LeaveCall(bool entered);
+
+  void Push(int slot, const Task &task);
+  bool TakeTask(int slot, const Group *only, Task &task);
+  void Execute(Task task, int slot);
+  void Wait(Group &group, int slot);
+};
+
+#endif
@@ -0,0 +1,358 @@
+// Headless simulation runner (no window, no GL).
+// Seeds a plume of particles, runs the SPH solver for a number of steps
+// with a given parameter set and prints one CSV row of timings per step, so
+// solver throughput can be measured and profiled on machines without a
+// display. Optionally dumps the particle state as CSV.
+//
+//   make headless
+//   ./build/SteamHeadless [--steps 600] [--particles 20000] [--capacity N]
+//                         [--threads 0] [--dt 0.016667 | --adaptive]
+//                         [--mode recompute|cached|verlet] [--pairs]
+//                         [--fused] [--reorder N] [--incremental]
+//                         [--kernel poly6|cubic|wendland] [--radius 1.0]
+//                         [--simd scalar|sse|avx2|avx512] [--emission 200]
+//                         [--cooling 0.3] [--seed 1234]
+//                         [--solver eos|iterative] [--tolerance 0.01]
+//                         [--max-iterations 20] [--no-warm-start]
+//                         [--integrator euler|leapfrog] [--drag 0.603]
+//                         [--dump state.csv] [--dump-every N]
+
+#include "../engine/Kernels.h"
+#include "../engine/SimulationClock.h"
+#include "../engine/SteamEngine.h"
+#include "../engine/ThreadPool.h"
+#include "../particle/ParticleStore.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Same room as main.cpp
+const float ROOM_MIN[3] = {-25.0f, -15.0f, -25.0f};
+const float ROOM_MAX[3] = {25.0f, 15.0f, 25.0f};
+
+struct Options {
+  int steps = 600;
+  int particles = 20000; // Seeded before the first step
+  int capacity = 0;      // Pool size, 0 = particles + room to emit
+  int threads = 0;
+  float dt = 1.0f / 60.0f;
+  bool adaptive = false; // SimulationClock's stable dt instead of 'dt'
+  NeighborMode mode = NeighborMode::Cached;
+  bool pairs = false;
+  bool fused = false;
+  int reorder = 0;
+  bool incremental = false;
+  Kernel::Family kernel = Kernel::Family::Poly6Spiky;
+  float radius = Kernel::Standard::params().h;
+  int simd = -1; // -1 = best supported
+  float emission = -1.0f; // < 0 = engine default
+  float cooling = -1.0f;
+  unsigned seed = 1234;
+  PressureSolver solver = PressureSolver::EquationOfState;
+  float tolerance = -1.0f;   // < 0 = engine default
+  int maxIterations = 0;     // 0 = engine default
+  bool warmStart = true;
+  Integrator integrator = Integrator::SymplecticEuler;
+  float drag = -1.0f; // < 0 = engine default
+  std::string dumpPath;
+  int dumpEvery = 0; // 0 = only after the last step
+};
+
+// A. Scene
+// The same column the emitter builds up over time: dense at the spout,
+// widening and thinning with height, hot and rising. The column is scaled
+// with the count so the neighbor counts stay those of the live scene
+// (about 5000 particles) instead of growing with the budget.
+void SeedPlume(SteamEngine &engine, int count, unsigned seed) {
+  std::mt19937 rng(seed);
+  const float scale = std::max(1.0f, std::cbrt(count / 5000.0f));
+  std::exponential_distribution<float> rise(1.0f / (6.0f * scale));
+  for (int i = 0; i < count; ++i) {
+    SteamParticle p;
+    p.active = true;
+    p.mass = 1.0f;
+    p.life = 10.0f;
+    float y;
+    do
+      y = -14.0f + rise(rng);
+    while (y > ROOM_MAX[1] - 0.5f);
+    std::normal_distribution<float> spread(
+        0.0f, (0.75f + 0.15f * (y + 14.0f)) * scale);
+    p.position[0] = std::max(ROOM_MIN[0], std::min(spread(rng), ROOM_MAX[0]));
+    p.position[1] = y;
+    p.position[2] = std::max(ROOM_MIN[2], std::min(spread(rng), ROOM_MAX[2]));
+    // Cooler the higher it got, as if it had been rising for a while
+    p.temperature = std::max(0.2f, 1.0f - 0.03f * (y + 14.0f));
+    glm_vec3_zero(p.velocity);
+    p.velocity[1] = 0.5f;
+    glm_vec3_zero(p.angularVelocity);
+    if (engine.AddParticle(p) < 0)
+      break;
+  }
+}
+
+// B. Output
+typedef std::chrono::steady_clock Clock;
+
+double ElapsedMs(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+void DumpState(FILE *out, int step, const SteamEngine &engine) {
+  const ParticleStore &ps = engine.getParticles();
+  for (int i = 0; i < engine.getUsedSlots(); ++i) {
+    if (!ps.isActive(i))
+      continue;
+    const float *x = ps.position(i);
+    const float *v = ps.velocity(i);
+    std::fprintf(out, "%d,%u,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n",
+                 step, ps.ids[i], x[0], x[1], x[2], v[0], v[1], v[2],
+                 ps.densities[i], ps.pressures[i], ps.temperatures[i]);
+  }
+}
+
+// C. Command line
+bool ParseMode(const char *arg, NeighborMode &mode) {
+  const char *names[] = {"recompute", "cached", "verlet"};
+  for (int m = 0; m < 3; ++m)
+    if (!std::strcmp(arg, names[m])) {
+      mode = (NeighborMode)m;
+      return true;
+    }
+  return false;
+}
+
+bool ParseKernel(const char *arg, Kernel::Family &family) {
+  const char *names[] = {"poly6", "cubic", "wendland"};
+  for (int f = 0; f < (int)Kernel::Family::Count; ++f)
+    if (!std::strcmp(arg, names[f])) {
+      family = (Kernel::Family)f;
+      return true;
+    }
+  return false;
+}
+
+bool ParseSimd(const char *arg, int &level) {
+  const char *names[] = {"scalar", "sse", "avx2", "avx512"};
+  for (int l = 0; l < 4; ++l)
+    if (!std::strcmp(arg, names[l])) {
+      level = l;
+      return true;
+    }
+  return false;
+}
+
+bool ParseSolver(const char *arg, PressureSolver &solver) {
+  const char *names[] = {"eos", "iterative"};
+  for (int s = 0; s < 2; ++s)
+    if (!std::strcmp(arg, names[s])) {
+      solver = (PressureSolver)s;
+      return true;
+    }
+  return false;
+}
+
+bool ParseIntegrator(const char *arg, Integrator &integrator) {
+  const char *names[] = {"euler", "leapfrog"};
+  for (int n = 0; n < 2; ++n)
+    if (!std::strcmp(arg, names[n])) {
+      integrator = (Integrator)n;
+      return true;
+    }
+  return false;
+}
+
+bool ParseArgs(int argc, char **argv, Options &opt) {
+  for (int i = 1; i < argc; ++i) {
+    bool hasValue = i + 1 < argc;
+    if (!std::strcmp(argv[i], "--steps") && hasValue)
+      opt.steps = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--particles") && hasValue)
+      opt.particles = std::max(0, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--capacity") && hasValue)
+      opt.capacity = std::max(0, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--threads") && hasValue)
+      opt.threads = std::max(0, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--dt") && hasValue)
+      opt.dt = std::max(1e-5f, (float)std::atof(argv[++i]));
+    else if (!std::strcmp(argv[i], "--adaptive"))
+      opt.adaptive = true;
+    else if (!std::strcmp(argv[i], "--mode") && hasValue) {
+      if (!ParseMode(argv[++i], opt.mode))
+        return false;
+    } else if (!std::strcmp(argv[i], "--pairs"))
+      opt.pairs = true;
+    else if (!std::strcmp(argv[i], "--fused"))
+      opt.fused = true;
+    else if (!std::strcmp(argv[i], "--reorder") && hasValue)
+      opt.reorder = std::max(0, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--incremental"))
+      opt.incremental = true;
+    else if (!std::strcmp(argv[i], "--kernel") && hasValue) {
+      if (!ParseKernel(argv[++i], opt.kernel))
+        return false;
+    } else if (!std::strcmp(argv[i], "--radius") && hasValue)
+      opt.radius = std::max(0.05f, (float)std::atof(argv[++i]));
+    else if (!std::strcmp(argv[i], "--simd") && hasValue) {
+      if (!ParseSimd(argv[++i], opt.simd))
+        return false;
+    } else if (!std::strcmp(argv[i], "--emission") && hasValue)
+      opt.emission = std::max(0.0f, (float)std::atof(argv[++i]));
+    else if (!std::strcmp(argv[i], "--cooling") && hasValue)
+      opt.cooling = std::max(0.0f, (float)std::atof(argv[++i]));
+    else if (!std::strcmp(argv[i], "--solver") && hasValue) {
+      if (!ParseSolver(argv[++i], opt.solver))
+        return false;
+    } else if (!std::strcmp(argv[i], "--tolerance") && hasValue)
+      opt.tolerance = std::max(0.0f, (float)std::atof(argv[++i]));
+    else if (!std::strcmp(argv[i], "--max-iterations") && hasValue)
+      opt.maxIterations = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--no-warm-start"))
+      opt.warmStart = false;
+    else if (!std::strcmp(argv[i], "--integrator") && hasValue) {
+      if (!ParseIntegrator(argv[++i], opt.integrator))
+        return false;
+    } else if (!std::strcmp(argv[i], "--drag") && hasValue)
+      opt.drag = std::max(0.0f, (float)std::atof(argv[++i]));
+    else if (!std::strcmp(argv[i], "--seed") && hasValue)
+      opt.seed = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+    else if (!std::strcmp(argv[i], "--dump") && hasValue)
+      opt.dumpPath = argv[++i];
+    else if (!std::strcmp(argv[i], "--dump-every") && hasValue)
+      opt.dumpEvery = std::max(0, std::atoi(argv[++i]));
+    else
+      return false;
+  }
+  if (opt.capacity == 0)
+    opt.capacity = opt.particles + 100000;
+  opt.capacity = std::max(opt.capacity, opt.particles);
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options opt;
+  if (!ParseArgs(argc, argv, opt)) {
+    std::fprintf(
+        stderr,
+        "usage: %s [--steps N] [--particles N] [--capacity N] [--threads N]\n"
+        "          [--dt S | --adaptive] [--mode recompute|cached|verlet]\n"
+        "          [--pairs] [--fused] [--reorder N] [--incremental]\n"
+        "          [--kernel poly6|cubic|wendland] [--radius H]\n"
+        "          [--simd scalar|sse|avx2|avx512] [--emission R]\n"
+        "          [--cooling R] [--seed N] [--dump FILE] [--dump-every N]\n"
+        "          [--solver eos|iterative] [--tolerance E]\n"
+        "          [--max-iterations N] [--no-warm-start]\n"
+        "          [--integrator euler|leapfrog] [--drag R]\n",
+        argv[0]);
+    return 1;
+  }
+
+  FILE *dump = nullptr;
+  if (!opt.dumpPath.empty()) {
+    dump = std::fopen(opt.dumpPath.c_str(), "w");
+    if (!dump) {
+      std::fprintf(stderr, "cannot open %s\n", opt.dumpPath.c_str());
+      return 1;
+    }
+    std::fprintf(dump, "step,id,x,y,z,vx,vy,vz,density,pressure,"
+                       "temperature\n");
+  }
+
+  // The emitter draws from rand()
+  std::srand(opt.seed);
+  Kernel::SetFamily(opt.kernel);
+  Kernel::SetRadius(opt.radius);
+  if (opt.simd >= 0)
+    Kernel::SetSimdLevel((Kernel::SimdLevel)opt.simd);
+
+  ThreadPool pool(opt.threads);
+  float spawnRange = 1.5f;
+  SteamEngine engine(spawnRange);
+  engine.SetThreadPool(&pool);
+  engine.Initialize(opt.capacity);
+  vec3 roomMin = {ROOM_MIN[0], ROOM_MIN[1], ROOM_MIN[2]};
+  vec3 roomMax = {ROOM_MAX[0], ROOM_MAX[1], ROOM_MAX[2]};
+  engine.SetDomainBounds(roomMin, roomMax);
+  engine.neighborMode = opt.mode;
+  engine.symmetricPairs = opt.pairs;
+  engine.fusedPasses = opt.fused;
+  engine.reorderInterval = opt.reorder;
+  engine.incrementalGrid = opt.incremental;
+  if (opt.emission >= 0.0f)
+    engine.emissionRate = opt.emission;
+  if (opt.cooling >= 0.0f)
+    engine.coolingRate = opt.cooling;
+  engine.pressureSolver = opt.solver;
+  if (opt.tolerance >= 0.0f)
+    engine.solverTolerance = opt.tolerance;
+  if (opt.maxIterations > 0)
+    engine.solverMaxIterations = opt.maxIterations;
+  engine.solverWarmStart = opt.warmStart;
+  engine.integrator = opt.integrator;
+  if (opt.drag >= 0.0f)
+    engine.drag = opt.drag;
+  SimulationClock clock;
+
+  SeedPlume(engine, opt.particles, opt.seed);
+
+  std::printf("# particles %d, capacity %d, threads %d, kernel %s h=%.3f, "
+              "simd %s\n",
+              engine.getActiveCount(), opt.capacity, pool.getThreadCount(),
+              Kernel::getFamilyName(Kernel::Current().family),
+              Kernel::Current().h,
+              Kernel::getSimdLevelName(Kernel::getSimdLevel()));
+  std::printf("step,active,dt,step_ms");
+  for (int ph = 0; ph < (int)EnginePhase::Count; ++ph)
+    std::printf(",%s_ms", SteamEngine::getPhaseName((EnginePhase)ph));
+  std::printf(",solver_iterations,solver_residual,max_speed,"
+              "neighbor_entries\n");
+
+  std::vector<double> stepMs;
+  stepMs.reserve(opt.steps);
+  double particleSteps = 0.0;
+  for (int step = 1; step <= opt.steps; ++step) {
+    float dt = opt.adaptive ? clock.StableDt(engine) : opt.dt;
+    Clock::time_point start = Clock::now();
+    engine.Update(dt);
+    double ms = ElapsedMs(start);
+    stepMs.push_back(ms);
+    particleSteps += engine.getActiveCount();
+
+    std::printf("%d,%d,%.6f,%.3f", step, engine.getActiveCount(), dt, ms);
+    for (int ph = 0; ph < (int)EnginePhase::Count; ++ph)
+      std::printf(",%.3f", engine.getPhaseStats((EnginePhase)ph).wallMs);
+    const PressureSolverStats &solver = engine.getPressureSolverStats();
+    std::printf(",%d,%.5f,%.4f,%zu\n", solver.iterations,
+                solver.residual, engine.getMotionStats().maxSpeed,
+                engine.getNeighborListEntries());
+
+    if (dump && (step == opt.steps ||
+                 (opt.dumpEvery > 0 && step % opt.dumpEvery == 0)))
+      DumpState(dump, step, engine);
+  }
+  if (dump)
+    std::fclose(dump);
+
+  // Summary on stderr, so stdout stays plain CSV
+  double total = 0.0;
+  for (double ms : stepMs)
+    total += ms;
+  std::sort(stepMs.begin(), stepMs.end());
+  std::fprintf(stderr,
+               "%d steps in %.1f ms: median %.3f ms, p95 %.3f ms, "
+               "%.2f M particle-steps/s\n",
+               opt.steps, total, stepMs[stepMs.size() / 2],
+               stepMs[stepMs.size() * 95 / 100],
+               total > 0.0 ? particleSteps / total / 1000.0 : 0.0);
+  return 0;
+}
@@ -4,6 +4,7 @@
 #include "room/Room.h"
 #include <GLFW/glfw3.h>
 #include <cglm/cglm.h>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -16,6 +17,9 @@ const unsigned int SCR_HEIGHT = 720;
 // Camera
 #include "camera/Camera.h"
 #include "engine/DensityVolume.h" // [NEW] Volumetric
+#include "engine/Kernels.h"
+#include "engine/SimulationClock.h"
+#include "engine/SimulationThread.h"
 #include "engine/SteamEngine.h"
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_glfw.h"
@@ -196,10 +200,25 @@ int main() {
               << std::endl;
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+  // Worker threads shared by the simulation, the volume build and render
+  // prep (declared first so it outlives the engine)
+  ThreadPool jobs;
+  std::vector<WorkerTrace> workerTrace;
+  std::vector<std::vector<float>> workerBusyHistory; // Busy share per frame
+  const size_t WORKER_HISTORY = 120;
+
   // Initialize Steam Engine
   float spawn_range_multiplier = 1.5f;
   SteamEngine steamEngine(spawn_range_multiplier);
+  steamEngine.SetThreadPool(&jobs);
   steamEngine.Initialize(2000000); // Start with capacity for 2000 particles
+  // Same box as the Room below the camera: 50x30x50 centered on the origin
+  vec3 roomMin = {-25.0f, -15.0f, -25.0f};
+  vec3 roomMax = {25.0f, 15.0f, 25.0f};
+  steamEngine.SetDomainBounds(roomMin, roomMax);
+  steamEngine.RequestGridAutotune(); // Runs once the plume has particles
+  // Turns wall time into stable-sized engine steps
+  SimulationClock simClock;
 
   // [NEW] Load Wall Texture
   unsigned int wallTexture;
@@ -226,6 +245,15 @@ int main() {
   }
   stbi_image_free(data);
 
+  // From here on the engine runs on its own thread. The UI edits
+  // simSettings and reads the latest snapshot; it never touches steamEngine.
+  SimulationSettings simSettings;
+  simSettings.CaptureFrom(steamEngine, simClock);
+  simSettings.paused = pause;
+  SimulationThread simThread(steamEngine, simClock);
+  simThread.Start(simSettings);
+  long volumeStep = -1; // Snapshot the density volume was built from
+
   // Render Loop
   while (!glfwWindowShouldClose(window)) {
     // Per-frame time logic
@@ -233,6 +261,9 @@ int main() {
     deltaTime = currentFrame - lastFrame;
     lastFrame = currentFrame;
 
+    // Latest completed step; stays put until the next Acquire
+    const SimulationSnapshot &snap = simThread.Acquire();
+
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
@@ -242,23 +273,185 @@ int main() {
     ImGui::Begin("Controller");
     ImGui::Text("Sim Stats");
 
-    int uiActiveCount = 0;
-    for (const auto &p : steamEngine.getParticles())
-      if (p.active)
-        uiActiveCount++;
-    ImGui::Text("Active Particles: %d", uiActiveCount);
+    ImGui::Text("Active Particles: %d", snap.activeCount);
+    ImGui::Text("Step %ld, %.1f s simulated, %.2f ms per step", snap.step,
+                snap.simulatedTime, snap.advanceMs);
+
+    int clockMode = (int)simSettings.clockMode;
+    if (ImGui::Combo("Time Step", &clockMode,
+                     "Frame delta\0Fixed\0Adaptive (CFL)\0"))
+      simSettings.clockMode = (ClockMode)clockMode;
+    if (simSettings.clockMode == ClockMode::Fixed)
+      ImGui::SliderFloat("Fixed dt", &simSettings.fixedDt, 1.0f / 480.0f,
+                         1.0f / 30.0f, "%.4f s");
+    if (simSettings.clockMode == ClockMode::Adaptive) {
+      ImGui::SliderFloat("CFL Number", &simSettings.cflNumber, 0.05f, 1.0f);
+      ImGui::SliderFloat("Max dt", &simSettings.maxDt, 1.0f / 480.0f,
+                         1.0f / 30.0f, "%.4f s");
+    }
+    if (simSettings.clockMode != ClockMode::Variable)
+      ImGui::SliderInt("Max Substeps", &simSettings.maxSubsteps, 1, 32);
+    int integrator = (int)simSettings.integrator;
+    if (ImGui::Combo("Integrator", &integrator,
+                     "Symplectic Euler\0Leapfrog (KDK)\0"))
+      simSettings.integrator = (Integrator)integrator;
+    const ClockStats &cs = snap.clock;
+    const MotionStats &ms = snap.motion;
+    ImGui::Text("dt %.2f ms x %d (stable %.2f ms), %ld capped frames",
+                cs.dt * 1000.0f, cs.substeps, cs.stableDt * 1000.0f,
+                cs.cappedFrames);
+    ImGui::Text("Max speed %.2f, max accel %.2f", ms.maxSpeed,
+                ms.maxAcceleration);
+
+    int maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+    ImGui::SliderInt("Threads", &simSettings.threadCount, 1, maxThreads);
+    // Batched SPH kernels: picked from the CPU at startup, can be lowered
+    int simdLevel = (int)simSettings.simdLevel;
+    if (ImGui::Combo("Kernel SIMD", &simdLevel,
+                     "Scalar\0SSE2\0AVX2\0AVX-512\0"))
+      simSettings.simdLevel = (Kernel::SimdLevel)simdLevel;
+    int kernelFamily = (int)simSettings.kernelFamily;
+    if (ImGui::Combo("Kernel", &kernelFamily,
+                     "Poly6 / Spiky\0Cubic spline\0Wendland C2\0"))
+      simSettings.kernelFamily = (Kernel::Family)kernelFamily;
+    ImGui::SliderFloat("Kernel Radius", &simSettings.kernelRadius, 0.5f,
+                       2.0f);
+    if (ImGui::CollapsingHeader("Phase Timing")) {
+      // Efficiency: share of thread time spent in loop bodies
+      for (int ph = 0; ph < (int)EnginePhase::Count; ph++) {
+        const PhaseStats &st = snap.phases[ph];
+        ImGui::Text("%-14s %6.2f ms  %3.0f%%",
+                    SteamEngine::getPhaseName((EnginePhase)ph), st.wallMs,
+                    st.efficiency * 100.0f);
+      }
+    }
+
+    // Per-worker load since the last frame (slot 0 = threads calling in)
+    jobs.TakeStats(workerTrace);
+    workerBusyHistory.resize(workerTrace.size());
+    for (size_t w = 0; w < workerTrace.size(); w++) {
+      float total = workerTrace[w].busyMs + workerTrace[w].idleMs;
+      std::vector<float> &history = workerBusyHistory[w];
+      history.push_back(total > 0.0f ? workerTrace[w].busyMs / total : 0.0f);
+      if (history.size() > WORKER_HISTORY)
+        history.erase(history.begin());
+    }
+    if (ImGui::CollapsingHeader("Workers")) {
+      for (size_t w = 0; w < workerTrace.size(); w++) {
+        char label[64];
+        snprintf(label, sizeof(label), "#%zu %5.1f ms, %ld steals", w,
+                 workerTrace[w].busyMs, workerTrace[w].steals);
+        ImGui::PlotLines(label, workerBusyHistory[w].data(),
+                         (int)workerBusyHistory[w].size(), 0, nullptr, 0.0f,
+                         1.0f, ImVec2(0, 30));
+      }
+    }
+
+    int neighborMode = (int)simSettings.neighborMode;
+    if (ImGui::Combo("Neighbor Search", &neighborMode,
+                     "Recompute\0Cached\0Verlet\0"))
+      simSettings.neighborMode = (NeighborMode)neighborMode;
+    ImGui::Text("Neighbor Lists: %.1f MB (%zu entries)",
+                snap.neighborListBytes / (1024.0 * 1024.0),
+                snap.neighborListEntries);
+    int gridCells = simSettings.gridCellsPerRadius - 1;
+    if (ImGui::Combo("Grid Cells", &gridCells,
+                     "h (27-cell stencil)\0h/2 (125-cell stencil)\0"))
+      simSettings.gridCellsPerRadius = gridCells + 1;
+    const GridTuning &gt = snap.gridTuning;
+    if (gt.done)
+      ImGui::Text("Autotune: h %.2f ms, h/2 %.2f ms", gt.msPerConfig[0],
+                  gt.msPerConfig[1]);
+    else if (gt.pending)
+      ImGui::Text("Autotune: waiting for particles");
+    ImGui::Checkbox("Incremental Grid", &simSettings.incrementalGrid);
+    if (simSettings.incrementalGrid) {
+      const GridUpdateStats &gu = snap.gridUpdate;
+      ImGui::Text("Migrated: %.1f%% (%ld incremental, %ld full)",
+                  gu.migratedFraction * 100.0f, gu.incrementalUpdates,
+                  gu.fullBuilds);
+    }
+    // Probe and diagnostics are computed by the simulation thread while
+    // their headers are open, and show up a snapshot later
+    simSettings.probe = ImGui::CollapsingHeader("Probe");
+    if (simSettings.probe) {
+      // Density at the camera and the closest particle to it
+      glm_vec3_copy(camera.Position, simSettings.probePosition);
+      if (snap.hasProbe) {
+        ImGui::Text("Density at camera: %.3f", snap.probeDensity);
+        if (snap.nearestId >= 0)
+          ImGui::Text("Nearest particle: #%d at %.2f m", snap.nearestId,
+                      snap.nearestDistance);
+        else
+          ImGui::Text("Nearest particle: none");
+      }
+    }
+    simSettings.gridDiagnostics = ImGui::CollapsingHeader("Grid Diagnostics");
+    if (simSettings.gridDiagnostics && snap.hasGridDiagnostics) {
+      const GridDiagnostics &gd = snap.gridDiagnostics;
+      ImGui::Text("%s, %d keys, load %.2f", gd.dense ? "Dense" : "Hashed",
+                  gd.tableSize, gd.loadFactor);
+      ImGui::Text("Occupied: %d, longest: %d", gd.occupiedBuckets,
+                  gd.maxBucketLength);
+      float bins[GridDiagnostics::HISTOGRAM_BINS];
+      for (int b = 0; b < GridDiagnostics::HISTOGRAM_BINS; b++)
+        bins[b] = (float)gd.histogram[b];
+      ImGui::PlotHistogram("Bucket Lengths", bins,
+                           GridDiagnostics::HISTOGRAM_BINS, 0,
+                           "0,1,2,3-4,5-8,9-16,17-32,33+", 0.0f, FLT_MAX,
+                           ImVec2(0, 60));
+      ImGui::Text("False candidates: %.1f%% (%ld duplicates, %ld queries)",
+                  gd.falseCandidateRatio * 100.0f, gd.duplicateCandidates,
+                  gd.sampledQueries);
+    }
+    ImGui::Checkbox("Symmetric Pairs (Half Shell)",
+                    &simSettings.symmetricPairs);
+    // Runs on neighbor lists (built every step in Recompute mode); compare
+    // against the three-pass pipeline
+    ImGui::Checkbox("Fused Passes (Cached Geometry)", &simSettings.fusedPasses);
+    // Iterative runs on neighbor lists (built every step in Recompute mode)
+    int pressureSolver = (int)simSettings.pressureSolver;
+    if (ImGui::Combo("Pressure", &pressureSolver,
+                     "Equation of state\0Iterative (implicit)\0"))
+      simSettings.pressureSolver = (PressureSolver)pressureSolver;
+    if (simSettings.pressureSolver == PressureSolver::Iterative) {
+      ImGui::SliderFloat("Solver Tolerance", &simSettings.solverTolerance,
+                         0.001f, 0.1f, "%.3f");
+      ImGui::SliderInt("Max Iterations", &simSettings.solverMaxIterations, 1,
+                       50);
+      ImGui::Checkbox("Warm Start", &simSettings.solverWarmStart);
+      const PressureSolverStats &pss = snap.pressureSolver;
+      ImGui::Text("Iterations: %d, residual %.4f%s", pss.iterations,
+                  pss.residual, pss.converged ? "" : " (not converged)");
+    }
+    ImGui::SliderInt("Morton Reorder Interval", &simSettings.reorderInterval,
+                     0, 600);
+    if (simSettings.reorderInterval > 0) {
+      const ReorderStats &rs = snap.reorder;
+      ImGui::Text("Reorders: %ld (last %.2f ms)", rs.reorders,
+                  rs.lastReorderMs);
+    }
+    if (simSettings.neighborMode == NeighborMode::Verlet) {
+      const NeighborStats &ns = snap.neighbors;
+      ImGui::SliderFloat("Verlet Skin", &simSettings.verletSkin, 0.0f, 1.0f);
+      ImGui::Text("Rebuilds: %ld / %ld steps (moved %ld, aged %ld)",
+                  ns.rebuilds, ns.verletSteps, ns.displacementRebuilds,
+                  ns.ageRebuilds);
+      ImGui::Text("Max Displacement: %.3f", ns.maxDisplacement);
+    }
 
     ImGui::Separator();
     ImGui::Checkbox("Debug Mode (Particles)", &debugMode);
-    ImGui::Checkbox("Pause Simulation", &pause);
+    ImGui::Checkbox("Pause Simulation", &simSettings.paused);
     ImGui::Checkbox("Use Wall Texture", &useWallTexture);
 
     ImGui::Separator();
     ImGui::Text("Physics Parameters");
-    ImGui::SliderFloat("Gravity", &steamEngine.gravity, -10.0f, 1.0f);
-    ImGui::SliderFloat("Buoyancy", &steamEngine.buoyancyCoeff, 0.0f, 10.0f);
-    ImGui::SliderFloat("Cooling Rate", &steamEngine.coolingRate, 0.0f, 2.0f);
-    ImGui::SliderFloat("Emission Rate", &steamEngine.emissionRate, 10.0f,
+    ImGui::SliderFloat("Gravity", &simSettings.gravity, -10.0f, 1.0f);
+    ImGui::SliderFloat("Buoyancy", &simSettings.buoyancyCoeff, 0.0f, 10.0f);
+    ImGui::SliderFloat("Cooling Rate", &simSettings.coolingRate, 0.0f, 2.0f);
+    ImGui::SliderFloat("Drag", &simSettings.drag, 0.0f, 5.0f);
+    ImGui::SliderFloat("Emission Rate", &simSettings.emissionRate, 10.0f,
                        1000.0f);
 
     // [NEW] Ray Marching Step Size
@@ -281,11 +474,14 @@ int main() {
     static int rayMarchSamples = 1;
     ImGui::SliderInt("Ray March Samples", &rayMarchSamples, 1, 16);
 
-    ImGui::SliderFloat("Spawn Range Multiplier", &spawn_range_multiplier, 0.5f,
+    ImGui::SliderFloat("Spawn Range Multiplier", &simSettings.spawnRange, 0.5f,
                        50.0f);
 
     ImGui::End();
 
+    // Picked up by the simulation thread at its next step boundary
+    simThread.Submit(simSettings);
+
     // Make sure to propagate ImGui input capture to camera?
     // If ImGui wants mouse, don't let camera take it.
     ImGuiIO &io = ImGui::GetIO();
@@ -293,40 +489,32 @@ int main() {
       processInput(window);
     }
 
-    // Update Steam Simulation
-    if (!pause)
-      steamEngine.Update(deltaTime);
-
-    // [NEW] Update Density Volume
-    densityVolume.Build(steamEngine.getParticles());
-    const auto &volData = densityVolume.getData();
-    glBindTexture(GL_TEXTURE_3D, volTexture);
-    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, dw, dh, dd, GL_RG, GL_FLOAT,
-                    volData.data());
-    glBindTexture(GL_TEXTURE_3D, 0);
+    // [NEW] Update Density Volume, once per new snapshot
+    if (snap.step != volumeStep) {
+      volumeStep = snap.step;
+      densityVolume.Build(snap.particles, snap.activeCount, &jobs);
+      const auto &volData = densityVolume.getData();
+      glBindTexture(GL_TEXTURE_3D, volTexture);
+      glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, dw, dh, dd, GL_RG, GL_FLOAT,
+                      volData.data());
+      glBindTexture(GL_TEXTURE_3D, 0);
+    }
 
     // DEBUG: Print status every 1 second
     static float debugTimer = 0.0f;
     debugTimer += deltaTime;
     if (debugTimer > 1.0f) {
       debugTimer = 0.0f;
-      const auto &particles = steamEngine.getParticles();
-      int activeCount = 0;
-      for (const auto &p : particles) {
-        if (p.active)
-          activeCount++;
-      }
-      std::cout << "[DEBUG] Active Particles: " << activeCount << std::endl;
+      std::cout << "[DEBUG] Active Particles: " << snap.activeCount
+                << std::endl;
 
       // Print first active particle pos
-      for (const auto &p : particles) {
-        if (p.active) {
-          std::cout << "   Sample Pos: (" << p.position[0] << ", "
-                    << p.position[1] << ", " << p.position[2] << ")"
-                    << " Temp: " << p.temperature << " Life: " << p.life
-                    << std::endl;
-          break;
-        }
+      if (snap.activeCount > 0) {
+        const float *p = snap.particles.position(0);
+        std::cout << "   Sample Pos: (" << p[0] << ", " << p[1] << ", "
+                  << p[2] << ")"
+                  << " Temp: " << snap.particles.temperatures[0]
+                  << std::endl;
       }
     }
 
@@ -448,22 +636,17 @@ int main() {
         glBindVertexArray(0);
       }
 
-      std::vector<float> particlePositions;
-      for (const auto &p : steamEngine.getParticles()) {
-        if (p.active) {
-          particlePositions.push_back(p.position[0]);
-          particlePositions.push_back(p.position[1]);
-          particlePositions.push_back(p.position[2]);
-        }
-      }
+      // The snapshot is already packed
+      const ParticleStore::FloatArray &particlePositions =
+          snap.particles.positions;
+      const size_t pointCount = snap.activeCount;
 
-      if (!particlePositions.empty()) {
+      if (pointCount > 0) {
         glBindBuffer(GL_ARRAY_BUFFER, particleVBO);
         // Ensure buffer is large enough if we exceeded initial guess (simple
         // realloc logic could go here) For now assuming 100k limit logic holds
         // or is sufficient for demo
-        glBufferSubData(GL_ARRAY_BUFFER, 0,
-                        particlePositions.size() * sizeof(float),
+        glBufferSubData(GL_ARRAY_BUFFER, 0, pointCount * 3 * sizeof(float),
                         particlePositions.data());
 
         glUseProgram(shaderProgram);
@@ -474,7 +657,7 @@ int main() {
 
         glBindVertexArray(particleVAO);
         glPointSize(5.0f); // Make them visible
-        glDrawArrays(GL_POINTS, 0, particlePositions.size() / 3);
+        glDrawArrays(GL_POINTS, 0, pointCount);
         glBindVertexArray(0);
         glPointSize(1.0f); // Reset
       }
@@ -613,6 +796,7 @@ int main() {
     glfwSwapBuffers(window);
     glfwPollEvents();
   }
+  simThread.Stop();
 
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplGlfw_Shutdown();
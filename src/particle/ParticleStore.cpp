@@ -0,0 +1,117 @@
+#include "ParticleStore.h"
+#include <algorithm>
+
+void ParticleStore::resize(size_t n) {
+  const SteamParticle defaults;
+  positions.resize(n * 3, 0.0f);
+  velocities.resize(n * 3, 0.0f);
+  forces.resize(n * 3, 0.0f);
+  angularVelocities.resize(n * 3, 0.0f);
+  masses.resize(n, defaults.mass);
+  densities.resize(n, defaults.density);
+  pressures.resize(n, defaults.pressure);
+  temperatures.resize(n, defaults.temperature);
+  lives.resize(n, defaults.life);
+  angles.resize(n, defaults.currentAngle);
+  ids.resize(n, defaults.id);
+  active.resize(n, 0);
+  count = n;
+}
+
+SteamParticle ParticleStore::get(size_t i) const {
+  SteamParticle p;
+  for (int a = 0; a < 3; ++a) {
+    p.position[a] = positions[i * 3 + a];
+    p.velocity[a] = velocities[i * 3 + a];
+    p.force[a] = forces[i * 3 + a];
+    p.angularVelocity[a] = angularVelocities[i * 3 + a];
+  }
+  p.currentAngle = angles[i];
+  p.mass = masses[i];
+  p.density = densities[i];
+  p.pressure = pressures[i];
+  p.temperature = temperatures[i];
+  p.life = lives[i];
+  p.id = ids[i];
+  p.active = active[i] != 0;
+  return p;
+}
+
+void ParticleStore::set(size_t i, const SteamParticle &p) {
+  for (int a = 0; a < 3; ++a) {
+    positions[i * 3 + a] = p.position[a];
+    velocities[i * 3 + a] = p.velocity[a];
+    forces[i * 3 + a] = p.force[a];
+    angularVelocities[i * 3 + a] = p.angularVelocity[a];
+  }
+  angles[i] = p.currentAngle;
+  masses[i] = p.mass;
+  densities[i] = p.density;
+  pressures[i] = p.pressure;
+  temperatures[i] = p.temperature;
+  lives[i] = p.life;
+  ids[i] = p.id;
+  active[i] = p.active ? 1 : 0;
+}
+
+void ParticleStore::Gather(const ParticleStore &src, const int *order,
+                           size_t n) {
+  resize(src.size());
+  // Field by field, so each pass streams one destination array
+  for (size_t k = 0; k < n; ++k)
+    std::copy(src.position(order[k]), src.position(order[k]) + 3,
+              position(k));
+  for (size_t k = 0; k < n; ++k)
+    std::copy(src.velocity(order[k]), src.velocity(order[k]) + 3,
+              velocity(k));
+  for (size_t k = 0; k < n; ++k)
+    std::copy(src.force(order[k]), src.force(order[k]) + 3, force(k));
+  for (size_t k = 0; k < n; ++k)
+    std::copy(src.angularVelocity(order[k]),
+              src.angularVelocity(order[k]) + 3, angularVelocity(k));
+  for (size_t k = 0; k < n; ++k) {
+    int s = order[k];
+    masses[k] = src.masses[s];
+    densities[k] = src.densities[s];
+    pressures[k] = src.pressures[s];
+    temperatures[k] = src.temperatures[s];
+    lives[k] = src.lives[s];
+    angles[k] = src.angles[s];
+    ids[k] = src.ids[s];
+    active[k] = src.active[s];
+  }
+  std::fill(active.begin() + n, active.end(), 0);
+}
+
+void ParticleStore::CopySlot(size_t dst, size_t src) {
+  for (int a = 0; a < 3; ++a) {
+    positions[dst * 3 + a] = positions[src * 3 + a];
+    velocities[dst * 3 + a] = velocities[src * 3 + a];
+    forces[dst * 3 + a] = forces[src * 3 + a];
+    angularVelocities[dst * 3 + a] = angularVelocities[src * 3 + a];
+  }
+  masses[dst] = masses[src];
+  densities[dst] = densities[src];
+  pressures[dst] = pressures[src];
+  temperatures[dst] = temperatures[src];
+  lives[dst] = lives[src];
+  angles[dst] = angles[src];
+  ids[dst] = ids[src];
+  active[dst] = active[src];
+}
+
+void ParticleStore::swap(ParticleStore &other) {
+  positions.swap(other.positions);
+  velocities.swap(other.velocities);
+  masses.swap(other.masses);
+  densities.swap(other.densities);
+  pressures.swap(other.pressures);
+  active.swap(other.active);
+  forces.swap(other.forces);
+  angularVelocities.swap(other.angularVelocities);
+  temperatures.swap(other.temperatures);
+  lives.swap(other.lives);
+  angles.swap(other.angles);
+  ids.swap(other.ids);
+  std::swap(count, other.count);
+}
@@ -0,0 +1,104 @@
+#ifndef PARTICLESTORE_H
+#define PARTICLESTORE_H
+
+#include "SteamParticle.h"
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Allocator handing out cache-line aligned blocks, so every field array
+// starts on a 64-byte boundary (full SIMD loads from element 0).
+template <typename T, size_t Alignment = 64> struct AlignedAllocator {
+  typedef T value_type;
+  template <typename U> struct rebind {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator() {}
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+  T *allocate(size_t n) {
+    void *p = nullptr;
+    if (posix_memalign(&p, Alignment, n * sizeof(T)) != 0)
+      throw std::bad_alloc();
+    return static_cast<T *>(p);
+  }
+  void deallocate(T *p, size_t) { std::free(p); }
+};
+
+template <typename T, typename U, size_t A>
+bool operator==(const AlignedAllocator<T, A> &,
+                const AlignedAllocator<U, A> &) {
+  return true;
+}
+template <typename T, typename U, size_t A>
+bool operator!=(const AlignedAllocator<T, A> &,
+                const AlignedAllocator<U, A> &) {
+  return false;
+}
+
+// Particle pool in structure-of-arrays layout: one aligned array per field,
+// so a loop that only needs positions and densities streams just those.
+// Vector fields are stored as xyz triples, so position(i) & co. can be
+// handed to anything that takes a vec3 (cglm, glBufferData).
+// get()/set() convert a slot to and from a SteamParticle record for the
+// places that want one (spawning, debug output, tools).
+class ParticleStore {
+public:
+  typedef std::vector<float, AlignedAllocator<float>> FloatArray;
+
+  ParticleStore() : count(0) {}
+
+  // New slots are inactive with SteamParticle's defaults
+  void resize(size_t n);
+  void clear() { resize(0); }
+  size_t size() const { return count; }
+
+  float *position(size_t i) { return &positions[i * 3]; }
+  const float *position(size_t i) const { return &positions[i * 3]; }
+  float *velocity(size_t i) { return &velocities[i * 3]; }
+  const float *velocity(size_t i) const { return &velocities[i * 3]; }
+  float *force(size_t i) { return &forces[i * 3]; }
+  const float *force(size_t i) const { return &forces[i * 3]; }
+  float *angularVelocity(size_t i) { return &angularVelocities[i * 3]; }
+  const float *angularVelocity(size_t i) const {
+    return &angularVelocities[i * 3];
+  }
+  bool isActive(size_t i) const { return active[i] != 0; }
+
+  SteamParticle get(size_t i) const;
+  void set(size_t i, const SteamParticle &p);
+
+  // Copy src's slots order[0..n) into slots 0..n of this store, sized like
+  // src; the slots past n are left inactive. Used to permute the pool
+  // without going through records.
+  void Gather(const ParticleStore &src, const int *order, size_t n);
+
+  // Overwrite slot dst with slot src, every field (active flag included)
+  void CopySlot(size_t dst, size_t src);
+
+  void swap(ParticleStore &other);
+
+  // Hot: read by every neighbor loop
+  FloatArray positions; // xyz
+  FloatArray velocities; // xyz
+  FloatArray masses;
+  FloatArray densities;
+  FloatArray pressures;
+  std::vector<unsigned char, AlignedAllocator<unsigned char>> active;
+
+  // Per-step but not per-neighbor
+  FloatArray forces;            // xyz
+  FloatArray angularVelocities; // xyz
+  FloatArray temperatures;
+  FloatArray lives;
+  FloatArray angles; // Render angle (SteamParticle::currentAngle)
+  std::vector<unsigned int> ids;
+
+private:
+  size_t count;
+};
+
+#endif
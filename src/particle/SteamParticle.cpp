@@ -4,7 +4,7 @@
 // Default constructor: creates an inactive particle
 SteamParticle::SteamParticle()
     : mass(1.0f), density(0.0f), pressure(0.0f), temperature(20.0f), life(0.0f),
-      active(false) {
+      id(0), active(false) {
   glm_vec3_zero(this->position);
   glm_vec3_zero(this->velocity);
   glm_vec3_zero(this->angularVelocity);
@@ -13,7 +13,8 @@ SteamParticle::SteamParticle()
 
 SteamParticle::SteamParticle(vec3 pos, vec3 vel, float m, float d, float p,
                              float t, float l)
-    : mass(m), density(d), pressure(p), temperature(t), life(l), active(true) {
+    : mass(m), density(d), pressure(p), temperature(t), life(l), id(0),
+      active(true) {
   glm_vec3_copy(pos, this->position);
   glm_vec3_copy(vel, this->velocity);
   glm_vec3_zero(this->angularVelocity);
@@ -46,6 +47,8 @@ float SteamParticle::getTemperature() const { return temperature; }
 
 float SteamParticle::getLife() const { return life; }
 
+unsigned int SteamParticle::getId() const { return id; }
+
 bool SteamParticle::isActive() const { return active; }
 
 void SteamParticle::setPosition(vec3 p) { glm_vec3_copy(p, this->position); }
@@ -20,6 +20,7 @@ public:
   float pressure;
   float temperature;
   float life;
+  unsigned int id; // Stable identity, survives reordering of the pool
   bool active;
 
   // Update method (placeholder for now)
@@ -39,6 +40,7 @@ public:
   float getPressure() const;
   float getTemperature() const;
   float getLife() const;
+  unsigned int getId() const;
   bool isActive() const;
 
   // Setters